@@ -152,7 +152,7 @@ keycode_map keycodes {
 	{ "kp_5", ::SDLK_KP_5 },
 	{ "kp_6", ::SDLK_KP_6 },
 	{ "kp_7", ::SDLK_KP_7 },
-	{ "kp_8", ::SDLK_KP_7 },
+	{ "kp_8", ::SDLK_KP_8 },
 	{ "kp_9", ::SDLK_KP_9 },
 	{ "kp_period", ::SDLK_KP_PERIOD },
 	{ "kp_equals", ::SDLK_KP_EQUALS },
@@ -171,6 +171,16 @@ keycode_map keycodes {
 
 };
 
+static keyname_map invert_keycodes(const keycode_map& keycodes)
+{
+	keyname_map keynames(keycodes.size());
+	for (auto it = keycodes.begin(); it != keycodes.end(); ++it)
+		keynames.insert(keyname_map::value_type(it->second, it->first));
+	return keynames;
+}
+
+keyname_map keynames(invert_keycodes(keycodes));
+
 } // global
 
 boost::program_options::options_description default_program_options()
@@ -188,6 +198,22 @@ boost::program_options::options_description default_program_options()
 		("base-path", boost::program_options::value<std::string>()
 			->default_value(boost::filesystem::current_path().string()), "set the base directory path")
 		("tmp-path", boost::program_options::value<std::string>(), "set the temporary directory path")
+		("profile-dump", boost::program_options::value<std::string>(),
+			"write frame phase percentiles as CSV to the given path on exit")
+		("trace-out", boost::program_options::value<std::string>(),
+			"write profiling zones as Chrome trace JSON to the given path on exit")
+		("alloc-report", boost::program_options::value<std::string>(),
+			"write heap allocations per zone and the top call stacks to the given path on exit")
+		("bench-frames", boost::program_options::value<::Uint32>(),
+			"run a headless, deterministic benchmark of the given number of frames")
+		("bench-out", boost::program_options::value<std::string>(),
+			"write benchmark frame statistics as JSON to the given path")
+		("record", boost::program_options::value<std::string>(),
+			"record the input events, frame timing and seed of the session to the given path")
+		("replay", boost::program_options::value<std::string>(),
+			"replay a session recorded with --record")
+		("replay-fast", boost::program_options::bool_switch(),
+			"replay as fast as possible instead of at the recorded speed")
 	;
 	return opt_desc;
 }
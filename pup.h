@@ -45,6 +45,13 @@
 #include "pup_m.h"
 #include "pup_t.h"
 #include "pup_io.h"
+#include "pup_mem.h"
+#include "pup_log.h"
+#include "pup_cfg.h"
+#include "pup_job.h"
+#include "pup_prf.h"
+#include "pup_mtr.h"
+#include "pup_rec.h"
 #include "pup_app.h"
 #include "pup_gl1.h"
 #include "pup_snd.h"
@@ -55,6 +62,7 @@ namespace pup {
 boost::program_options::options_description default_program_options();
 
 typedef std::map<std::string, ::SDL_Keycode> keycode_map;
+typedef std::unordered_map<::SDL_Keycode, std::string> keyname_map;
 
 namespace global {
 
@@ -63,6 +71,11 @@ namespace global {
  */
 extern keycode_map keycodes;
 
+/**
+ * The inverse of %keycodes, built once at startup.
+ */
+extern keyname_map keynames;
+
 } // global
 
 } // pup
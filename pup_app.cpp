@@ -40,8 +40,128 @@
 
 namespace pup {
 
+// Keycodes of keys without a character map directly to their
+// scancode, only character keys depend on the keyboard layout.
+static ::SDL_Scancode scancode_of(::SDL_Keycode key) throw()
+{
+	if (key & SDLK_SCANCODE_MASK)
+		return static_cast<::SDL_Scancode>(key & ~SDLK_SCANCODE_MASK);
+	return ::SDL_GetScancodeFromKey(key);
+}
+
+unsigned int key_chord::mods_of(::Uint16 keymod) throw()
+{
+	unsigned int mods = 0;
+	if (keymod & KMOD_CTRL)
+		mods |= MOD_CTRL;
+	if (keymod & KMOD_SHIFT)
+		mods |= MOD_SHIFT;
+	if (keymod & KMOD_ALT)
+		mods |= MOD_ALT;
+	if (keymod & KMOD_GUI)
+		mods |= MOD_GUI;
+	return mods;
+}
+
+std::string key_chord::mods_name(unsigned int mods)
+{
+	std::string name;
+	if (mods & MOD_CTRL)
+		name += "ctrl+";
+	if (mods & MOD_SHIFT)
+		name += "shift+";
+	if (mods & MOD_ALT)
+		name += "alt+";
+	if (mods & MOD_GUI)
+		name += "gui+";
+	return name;
+}
+
+key_chord key_chord::parse(const std::string& text)
+{
+	string_vector parts;
+	boost::split(parts, text, boost::is_any_of("+"));
+
+	key_chord chord;
+	for (size_type i = 0; i + 1 < parts.size(); i++) {
+		std::string mod = boost::trim_copy(parts[i]);
+		if (mod == "ctrl")
+			chord.mods |= MOD_CTRL;
+		else if (mod == "shift")
+			chord.mods |= MOD_SHIFT;
+		else if (mod == "alt")
+			chord.mods |= MOD_ALT;
+		else if (mod == "gui")
+			chord.mods |= MOD_GUI;
+		else
+			PUP_ERR(std::runtime_error, boost::str(boost::format("invalid modifier %1% in %2%")
+				% mod % text));
+	}
+
+	auto pair = global::keycodes.find(boost::trim_copy(parts.back()));
+	if (pair == global::keycodes.end())
+		PUP_ERR(std::runtime_error, boost::str(boost::format("invalid key %1%") % text));
+
+	chord.scancode = scancode_of(pair->second);
+	if (chord.scancode <= SDL_SCANCODE_UNKNOWN || chord.scancode >= SDL_NUM_SCANCODES)
+		PUP_ERR(std::runtime_error, boost::str(boost::format("key %1% has no scancode") % text));
+	return chord;
+}
+
+action_map::action_map(const cfg::config& config) :
+	values_(config.values)
+{
+}
+
+action_map::~action_map() throw()
+{
+}
+
+// Returned by value since the map may be reset by the main
+// thread while a controller loading on a worker binds keys.
+action_map::chord_vector action_map::find(const std::string& action)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	auto pair = actions_.find(action);
+	if (pair != actions_.end())
+		return pair->second;
+
+	auto keys = values_.find(action);
+	if (keys == values_.end())
+		PUP_ERR(std::runtime_error, boost::str(boost::format("binding %1% is missing") % action));
+
+	string_vector parts;
+	boost::split(parts, keys->second, boost::is_any_of(","));
+
+	chord_vector chords;
+	for (auto it = parts.begin(); it != parts.end(); ++it) {
+		try {
+			chords.push_back(key_chord::parse(*it));
+		}
+		catch (const std::exception& e) {
+			PUP_ERR(std::runtime_error, boost::str(boost::format("binding %1% specifies %2%")
+				% action % e.what()));
+		}
+	}
+
+	actions_.insert(chord_map::value_type(action, chords));
+	return chords;
+}
+
+void action_map::reset(const cfg::config& config)
+{
+	cfg::config::value_map values(config.values);
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	values_.swap(values);
+	actions_.clear();
+}
+
 key_dispatcher::key_dispatcher(application& app) :
-	app_(app)
+	app_(app),
+	table_(SDL_NUM_SCANCODES * key_chord::MOD_COMBINATIONS, 0),
+	generation_(app.get_config_generation())
 {
 }
 
@@ -52,30 +172,321 @@ key_dispatcher::~key_dispatcher() throw()
 void key_dispatcher::add_bindable(key_function func, const std::string& name,
 	const std::string& section)
 {
-	std::string i = boost::str(boost::format("%1%.%2%") % section % name);
-	std::string key = app_.get_ptree().get<std::string>(i);
-	auto pair = global::keycodes.find(key);
-	if (pair == global::keycodes.end()) {
-		PUP_ERR(std::runtime_error, boost::str(boost::format("binding %1%.%2% specifies invalid key %3%")
-			% section % name % key));
+	binding b = { func, name, section };
+	this->bind(bindings_.size(), b);
+	bindings_.push_back(b);
+}
+
+// Resolve all bindings again after the config has been reloaded.
+// Bindings to invalid keys are left unbound.
+void key_dispatcher::rebind()
+{
+	std::fill(table_.begin(), table_.end(), 0);
+	generation_ = app_.get_config_generation();
+
+	for (size_type i = 0; i < bindings_.size(); i++) {
+		try {
+			this->bind(i, bindings_[i]);
+		}
+		catch (const std::exception& e) {
+			PUP_LOG(error) << e.what();
+		}
 	}
+}
+
+// The table is only written once every chord has been parsed,
+// a binding that throws leaves no slots behind. A chord already
+// claimed by an earlier binding keeps it.
+void key_dispatcher::bind(size_type index, const binding& b)
+{
+	if (index >= std::numeric_limits<::Uint16>::max())
+		PUP_ERR(std::runtime_error, "too many key bindings");
 
-	dispatch_map_.insert(dispatch_map::value_type(pair->second, func));
+	const action_map::chord_vector chords = app_.get_actions().find(
+		b.section + "." + b.name);
+
+	for (auto it = chords.begin(); it != chords.end(); ++it) {
+		::Uint16& slot = table_[it->scancode * key_chord::MOD_COMBINATIONS + it->mods];
+		if (slot && slot != index + 1) {
+			const binding& other = bindings_[slot - 1];
+			PUP_LOG(warning) << boost::format("binding %1%.%2% ignores %3%%4%,"
+				" it is bound to %5%.%6%")
+				% b.section % b.name
+				% key_chord::mods_name(it->mods) % ::SDL_GetScancodeName(it->scancode)
+				% other.section % other.name;
+			continue;
+		}
+		slot = static_cast<::Uint16>(index + 1);
+	}
 }
 
 bool key_dispatcher::handle(::SDL_Event& event)
 {
+	if (generation_ != app_.get_config_generation())
+		this->rebind();
+
 	if (event.type == SDL_KEYDOWN) {
-		auto pair = dispatch_map_.find(event.key.keysym.sym);
-		if (pair != dispatch_map_.end())
-			return pair->second(event);
+		const ::SDL_Scancode scancode = event.key.keysym.scancode;
+		if (scancode < 0 || scancode >= SDL_NUM_SCANCODES)
+			return false;
+
+		const size_type base = scancode * key_chord::MOD_COMBINATIONS;
+		::Uint16 slot = table_[base + key_chord::mods_of(event.key.keysym.mod)];
+		if (!slot)
+			slot = table_[base];
+		if (slot)
+			return bindings_[slot - 1].func(event);
 	}
 	return false;
 }
 
+frame_pacer::frame_pacer(double rate, ::Sint64 spin) throw() :
+	rate_(0.0),
+	period_(0),
+	spin_(0),
+	deadline_(0),
+	last_miss_(0),
+	missed_(0)
+{
+	this->set_rate(rate);
+	this->set_spin(spin);
+}
+
+void frame_pacer::wait() throw()
+{
+	if (!period_)
+		return;
+
+	::Sint64 now = hr_timer::now();
+
+	if (!deadline_) {
+		deadline_ = now + period_;
+		return;
+	}
+
+	if (now > deadline_) {
+		missed_++;
+		last_miss_ = now - deadline_;
+		deadline_ = now + period_;
+		return;
+	}
+
+	frame_pacer::sleep_until(deadline_, spin_);
+	deadline_ += period_;
+}
+
+void frame_pacer::sleep_until(::Sint64 deadline, ::Sint64 spin) throw()
+{
+	const ::Sint64 sleep = deadline - hr_timer::now() - spin;
+	if (sleep >= 1000000)
+		::SDL_Delay(static_cast<::Uint32>(sleep / 1000000));
+
+	while (hr_timer::now() < deadline)
+		std::this_thread::yield();
+}
+
+void frame_pacer::reset() throw()
+{
+	deadline_ = 0;
+	last_miss_ = 0;
+	missed_ = 0;
+}
+
+void frame_pacer::set_rate(double rate) throw()
+{
+	rate_ = rate > 0.0? rate: 0.0;
+	period_ = rate_ > 0.0? static_cast<::Sint64>(1e9 / rate_): 0;
+	deadline_ = 0;
+}
+
+simulation_thread::simulation_thread() :
+	busy_(false),
+	quit_(false)
+{
+}
+
+simulation_thread::~simulation_thread() throw()
+{
+	if (thread_.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			quit_ = true;
+		}
+		cond_.notify_all();
+		thread_.join();
+	}
+}
+
+void simulation_thread::run(const task_function& task)
+{
+	this->wait();
+
+	if (!thread_.joinable())
+		thread_ = std::thread(&simulation_thread::work, this);
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		task_ = task;
+		busy_ = true;
+	}
+	cond_.notify_all();
+}
+
+void simulation_thread::wait()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	cond_.wait(lock, [this]() { return !busy_; });
+
+	if (error_) {
+		std::exception_ptr error(error_);
+		error_ = nullptr;
+		std::rethrow_exception(error);
+	}
+}
+
+bool simulation_thread::busy() throw()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return busy_;
+}
+
+void simulation_thread::work()
+{
+	PUP_THREAD_NAME("simulation");
+
+	std::unique_lock<std::mutex> lock(mutex_);
+
+	for (;;) {
+		cond_.wait(lock, [this]() { return busy_ || quit_; });
+		if (quit_)
+			break;
+
+		task_function task;
+		task.swap(task_);
+		lock.unlock();
+		try {
+			task();
+		}
+		catch (...) {
+			lock.lock();
+			error_ = std::current_exception();
+			lock.unlock();
+		}
+		lock.lock();
+		busy_ = false;
+		cond_.notify_all();
+	}
+}
+
+event_pump::event_pump(size_type capacity) :
+	frame_received_(0),
+	frame_delivered_(0),
+	received_(0),
+	delivered_(0)
+{
+	this->set_capacity(capacity);
+}
+
+event_span event_pump::pump(bool same_frame)
+{
+	::SDL_PumpEvents();
+
+	const int n = ::SDL_PeepEvents(&events_[0], static_cast<int>(events_.size()),
+		SDL_GETEVENT, SDL_FIRSTEVENT, SDL_LASTEVENT);
+	if (n < 0)
+		PUP_ERR(std::runtime_error, ::SDL_GetError());
+
+	const size_type received = static_cast<size_type>(n);
+	const size_type delivered = event_pump::coalesce(&events_[0], received);
+
+	if (!same_frame) {
+		frame_received_ = 0;
+		frame_delivered_ = 0;
+	}
+	frame_received_ += received;
+	frame_delivered_ += delivered;
+	received_ += received;
+	delivered_ += delivered;
+
+	return event_span(&events_[0], delivered);
+}
+
+event_span event_pump::replace(const ::SDL_Event* events, size_type n)
+{
+	if (n > events_.size())
+		events_.resize(n);
+
+	std::copy(events, events + n, events_.begin());
+	frame_delivered_ = n;
+
+	return event_span(&events_[0], n);
+}
+
+void event_pump::set_capacity(size_type capacity)
+{
+	events_.resize(std::max<size_type>(capacity, 1));
+}
+
+size_type event_pump::coalesce(::SDL_Event* events, size_type n) throw()
+{
+	auto is_resize = [](const ::SDL_Event& e) -> bool
+	{
+		return e.type == SDL_WINDOWEVENT && (
+			e.window.event == SDL_WINDOWEVENT_RESIZED ||
+			e.window.event == SDL_WINDOWEVENT_SIZE_CHANGED
+		);
+	};
+
+	// Drop every resize event followed by a later one of the same
+	// kind for the same window. Superseded events are marked by
+	// setting their type to SDL_FIRSTEVENT.
+	std::array<std::pair<::Uint32, ::Uint8>, 8> seen;
+	size_type seen_n = 0;
+
+	for (size_type i = n; i-- > 0; ) {
+		if (!is_resize(events[i]))
+			continue;
+		auto key = std::make_pair(events[i].window.windowID, events[i].window.event);
+		if (std::find(seen.begin(), seen.begin() + seen_n, key) != seen.begin() + seen_n)
+			events[i].type = SDL_FIRSTEVENT;
+		else if (seen_n < seen.size())
+			seen[seen_n++] = key;
+	}
+
+	size_type kept = 0;
+
+	for (size_type i = 0; i < n; ++i) {
+		const ::SDL_Event& e(events[i]);
+		if (e.type == SDL_FIRSTEVENT)
+			continue;
+
+		if (kept && e.type == SDL_MOUSEMOTION) {
+			::SDL_MouseMotionEvent& prev(events[kept - 1].motion);
+			if (
+				prev.type == SDL_MOUSEMOTION &&
+				prev.windowID == e.motion.windowID &&
+				prev.which == e.motion.which &&
+				prev.state == e.motion.state
+			) {
+				prev.x = e.motion.x;
+				prev.y = e.motion.y;
+				prev.xrel += e.motion.xrel;
+				prev.yrel += e.motion.yrel;
+				continue;
+			}
+		}
+
+		if (kept != i)
+			events[kept] = e;
+		kept++;
+	}
+	return kept;
+}
+
 controller::controller(application& app) :
 	app_(app),
-	key_dispatcher_(app)
+	key_dispatcher_(app),
+	progress_(0.0f)
 {
 }
 
@@ -88,6 +499,16 @@ bool controller::react(::SDL_Event& event)
 	return key_dispatcher_.handle(event);
 }
 
+size_type controller::react_batch(const event_span& events)
+{
+	size_type consumed = 0;
+	for (auto it = events.begin(); it != events.end(); ++it) {
+		if (this->react(*it))
+			consumed++;
+	}
+	return consumed;
+}
+
 application::application(
 	::Uint32 sdl_flags,
 	const boost::program_options::variables_map& opt_vm
@@ -96,64 +517,134 @@ application::application(
 	window_surface_(nullptr),
 	loop_(true),
 	first_config_(true),
-	frame_delay_(0),
+	pipelined_(false),
+	background_(false),
+	minimized_(false),
 	frame_count_(0),
 	frames_per_second_(0),
 	rendered_frames_(0),
-	event_tick_lim_(64),
+	tick_rate_(0),
+	tick_lim_(5),
+	tick_accumulator_(0),
+	alpha_(1.0),
+	bench_frames_(opt_vm.count("bench-frames")? opt_vm["bench-frames"].as<::Uint32>(): 0),
+	loop_start_(0),
+	startup_begin_(prf::now()),
+	seed_(0),
+	replay_fast_(opt_vm.count("replay-fast") && opt_vm["replay-fast"].as<bool>()),
+	io_budget_(1000000),
+	io_threaded_(false),
+	actions_(cfg_),
+	config_generation_(0),
+	config_preloaded_(false),
 	opt_vm_(opt_vm),
 	music_(nullptr),
 	jukebox_(nullptr),
 	soundboard_(nullptr),
+	job_system_(nullptr),
+	think_ns_(0),
+	think_counters_(),
 	misc_interval_(timer_, 250),
-	status_interval_(timer_, 1000)
+	status_interval_(timer_, 1000),
+	main_thread_id_(std::this_thread::get_id())
 {
-	if (::SDL_Init(sdl_flags) < 0)
-		PUP_ERR(std::runtime_error, ::SDL_GetError());
-	
-	if (::Mix_OpenAudio(MIX_DEFAULT_FREQUENCY, MIX_DEFAULT_FORMAT, 2, 2048) < 0)
-		PUP_ERR(std::runtime_error, ::Mix_GetError());
-	
-	gl_major_ = opt_vm_["opengl-major"].as<int>();
-	gl_minor_ = opt_vm_["opengl-minor"].as<int>();
+	job::graph startup;
 
-	::SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, gl_major_);
-	::SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, gl_minor_);
-	
-	window_ = ::SDL_CreateWindow(
-		application_name(),
-		SDL_WINDOWPOS_UNDEFINED,
-		SDL_WINDOWPOS_UNDEFINED,
-		640,
-		480,
-		SDL_WINDOW_SHOWN | SDL_WINDOW_OPENGL
-	);
-	
-	if (!window_)
-		PUP_ERR(std::runtime_error, ::SDL_GetError());
-	
-	window_surface_ = ::SDL_GetWindowSurface(window_);
-	gl_context_ = ::SDL_GL_CreateContext(window_);
+	const job::graph::node sdl = startup.add("sdl_init", [&]() {
+		// Benchmarks run without a display: SDL renders through its
+		// offscreen (EGL pbuffer) video driver, which Mesa backs with
+		// llvmpipe when no GPU is available. Variables already set in
+		// the environment take precedence.
+		if (bench_frames_) {
+			::SDL_setenv("SDL_VIDEODRIVER", "offscreen", 0);
+			::SDL_setenv("EGL_PLATFORM", "surfaceless", 0);
+		}
 
-	if (!gl_context_)
-		PUP_ERR(std::runtime_error, ::SDL_GetError());
-	
-	::glewExperimental = GL_TRUE;
-	GLenum glew_err = ::glewInit();
-	if (glew_err != GLEW_OK) {
-		PUP_ERR(std::runtime_error, reinterpret_cast<const char*>
-			(::glewGetErrorString(glew_err)));
-	}
+		if (::SDL_Init(sdl_flags) < 0)
+			PUP_ERR(std::runtime_error, ::SDL_GetError());
+	}, job::graph::node_vector(), true);
 
-	::glGenVertexArrays(1, &vertex_array_id_);
-	::glBindVertexArray(vertex_array_id_);
+	const job::graph::node window = startup.add("window", [&]() {
+		gl_major_ = opt_vm_["opengl-major"].as<int>();
+		gl_minor_ = opt_vm_["opengl-minor"].as<int>();
 
-	music_ = new snd::music();
-	jukebox_ = new snd::jukebox();
-	soundboard_ = new snd::soundboard();
-	if (!(music_ && jukebox_ && soundboard_)) {
-		PUP_ERR(std::runtime_error, "out of memory");
+		::SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, gl_major_);
+		::SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, gl_minor_);
+		
+		window_ = ::SDL_CreateWindow(
+			application_name(),
+			SDL_WINDOWPOS_UNDEFINED,
+			SDL_WINDOWPOS_UNDEFINED,
+			640,
+			480,
+			(bench_frames_? SDL_WINDOW_HIDDEN: SDL_WINDOW_SHOWN) | SDL_WINDOW_OPENGL
+		);
+		
+		if (!window_)
+			PUP_ERR(std::runtime_error, ::SDL_GetError());
+		
+		window_surface_ = ::SDL_GetWindowSurface(window_);
+	}, { sdl }, true);
+
+	// Opening the audio device may take a long time. It overlaps
+	// creating the GL context, but SDL must not open audio and
+	// create the window at the same time.
+	startup.add("audio_open", [&]() {
+		if (::Mix_OpenAudio(MIX_DEFAULT_FREQUENCY, MIX_DEFAULT_FORMAT, 2, 2048) < 0)
+			PUP_ERR(std::runtime_error, ::Mix_GetError());
+
+		music_ = new snd::music();
+		jukebox_ = new snd::jukebox();
+		soundboard_ = new snd::soundboard();
+		if (!(music_ && jukebox_ && soundboard_)) {
+			PUP_ERR(std::runtime_error, "out of memory");
+		}
+	}, { window });
+
+	const job::graph::node context = startup.add("gl_context", [&]() {
+		gl_context_ = ::SDL_GL_CreateContext(window_);
+
+		if (!gl_context_)
+			PUP_ERR(std::runtime_error, ::SDL_GetError());
+	}, { window }, true);
+
+	startup.add("glew", [&]() {
+		::glewExperimental = GL_TRUE;
+		GLenum glew_err = ::glewInit();
+		if (glew_err != GLEW_OK) {
+			PUP_ERR(std::runtime_error, reinterpret_cast<const char*>
+				(::glewGetErrorString(glew_err)));
+		}
+
+		::glGenVertexArrays(1, &vertex_array_id_);
+		::glBindVertexArray(vertex_array_id_);
+	}, { context }, true);
+
+	// The config is parsed up front, %configure() applies it.
+	const job::graph::node config = startup.add("config", [&]() {
+		this->read_config();
+		config_preloaded_ = true;
+	});
+
+	startup.add("job_system", [&]() {
+		job_system_ = new job::scheduler(cfg_.job_workers);
+	}, { config });
+
+	startup.add("replay", [&]() {
+		player_ = rec::open_player(opt_vm_);
+	});
+
+	startup.run();
+
+	std::string phases;
+	for (job::graph::node n = 0; n < startup.size(); ++n) {
+		phases += boost::str(boost::format("\t%1%=%2$.2fms\n")
+			% startup.get_name(n)
+			% (startup.get_duration(n) / 1e6));
 	}
+	PUP_LOG(info) << boost::format("pup::application::application(): %1$.2fms\n%2%")
+		% (startup.get_total() / 1e6)
+		% phases;
 
 	::SDL_version linked;
 	::SDL_GetVersion(&linked);
@@ -170,6 +661,13 @@ application::application(
 
 application::~application() throw()
 {
+	this->stop_io();
+	this->stop_metrics();
+
+	scaler_.reset();
+	limiter_.reset();
+	input_latency_.set_fence(false);
+	delete job_system_;
 	delete music_;
 	delete jukebox_;
 	delete soundboard_;
@@ -180,7 +678,9 @@ application::~application() throw()
 	::SDL_Quit();
 }
 
-void application::configure()
+// Read and validate the config file, copying the original
+// config file first if it does not exist.
+void application::read_config()
 {
 	boost::filesystem::path config(this->get_config_path());
 	boost::filesystem::path config_orig(PUP_CONFIG_PATH "-orig");
@@ -190,31 +690,67 @@ void application::configure()
 			PUP_ERR(std::runtime_error, "can not find original config file");
 		}
 		boost::filesystem::copy_file(config_orig, config);
-		BOOST_LOG_TRIVIAL(warning) << boost::format("failed to load config \"%1%\""
+		PUP_LOG(warning) << boost::format("failed to load config \"%1%\""
 			" copying original config")	% config.string();
 	}
 
 	pt_.clear();
 	boost::property_tree::ini_parser::read_ini(config.string(), pt_);
+	cfg_.load(pt_);
+	actions_.reset(cfg_);
+	config_generation_++;
+}
 
-	unsigned int vsync = pt_.get<unsigned int>("graphics.vsync");
-	unsigned int seed = opt_vm_.count("random-seed")? opt_vm_["random-seed"].as<unsigned int>():
-		pt_.get<unsigned int>("general.random_seed")? pt_.get<unsigned int>("general.random_seed"):
-			static_cast<unsigned int>(std::time(nullptr));
+void application::configure()
+{
+	// The first time around the config has already been read
+	// during startup.
+	if (!config_preloaded_)
+		this->read_config();
+	config_preloaded_ = false;
+
+	unsigned int seed = player_? player_->get_seed():
+		opt_vm_.count("random-seed")? opt_vm_["random-seed"].as<unsigned int>():
+		cfg_.random_seed? cfg_.random_seed:
+			bench_frames_? 1: static_cast<unsigned int>(std::time(nullptr));
 	
 	std::srand(seed);
+	seed_ = seed;
 
 	::SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
 	::SDL_GL_SetAttribute(SDL_GL_DEPTH_SIZE, 24);
 	::SDL_GL_SetAttribute(SDL_GL_MULTISAMPLEBUFFERS, 4);
 
-	music_->set_volume(pt_.get<int>("sound.music_volume"));
+	music_->set_volume(cfg_.music_volume);
 
-	if (::SDL_GL_SetSwapInterval(vsync == 1) < 0) {
-		BOOST_LOG_TRIVIAL(warning) << boost::format("failed to set v-sync: %1%")
-			% ::SDL_GetError();
+	tick_rate_ = cfg_.tick_rate;
+	tick_lim_ = cfg_.tick_lim;
+	tick_accumulator_ = 0;
+
+	pipelined_ = cfg_.pipelined;
+
+	io_budget_ = cfg_.io_budget_us * 1000;
+	io_threaded_ = cfg_.io_thread;
+
+	event_pump_.set_capacity(cfg_.event_batch);
+
+	const size_type profile_frames = std::max<size_type>(cfg_.profile_frames, bench_frames_);
+	if (first_config_ || profiler_.get_window() != profile_frames) {
+		profiler_.set_window(profile_frames);
+		input_latency_.set_window(profile_frames);
+	}
+	if (profiler_.has_counters() != cfg_.profile_counters
+		&& !profiler_.set_counters(cfg_.profile_counters)) {
+		PUP_LOG(warning) << boost::format("hardware counters unavailable: %1%")
+			% prf::hw_counters::local().get_error();
 	}
 
+	this->apply_frame_rate();
+	this->apply_vsync();
+	this->apply_flight_recorder();
+	this->apply_latency();
+	this->apply_frame_latency();
+
 	if (first_config_) {
 		first_config_ = false;
 
@@ -239,17 +775,192 @@ void application::configure()
 		::glEnable(GL_COLOR_MATERIAL);
 	}
 
-	int width = pt_.get<int>("graphics.window_width");
-	int height = pt_.get<int>("graphics.window_height");
+	this->apply_window();
+
+	this->apply_config_watch();
+
+	PUP_LOG(info)	<< boost::format(
+		"pup::application::configure()\n"
+		"\tseed=%1%\n"
+		"\tw=%2%, h=%3%\n"
+		"\tfov=%4%, ratio=%5%, vsync=%6%, fullscreen=%7%\n"
+		"\ttick_rate=%8%, tick_lim=%9%, frame_rate=%10%, pipelined=%11%\n"
+		"\tjob_workers=%12%, io_budget_us=%13%, io_thread=%14%\n"
+	)
+		% seed
+		% cfg_.window_width
+		% cfg_.window_height
+		% cfg_.fov
+		% (static_cast<float>(cfg_.window_width) / cfg_.window_height)
+		% (bench_frames_? 0: cfg_.vsync)
+		% (!bench_frames_ && cfg_.window_fullscreen)
+		% tick_rate_
+		% tick_lim_
+		% frame_pacer_.get_rate()
+		% pipelined_
+		% job_system_->get_worker_count()
+		% (io_budget_ / 1000)
+		% io_threaded_;
+}
+
+// Re-read the config file at a frame boundary and apply only the
+// settings that changed. Unlike %configure() no GL state is set
+// up again. A config file that fails to parse or validate is
+// ignored, keeping the current settings.
+void application::reload_config()
+{
+	boost::property_tree::ptree pt;
+	cfg::config next;
+
+	try {
+		boost::property_tree::ini_parser::read_ini(this->get_config_path(), pt);
+		next.load(pt);
+	}
+	catch (const std::exception& e) {
+		PUP_LOG(warning) << boost::format("ignoring changed config: %1%")
+			% e.what();
+		return;
+	}
+
+	const cfg::config prev(cfg_);
+	pt_.swap(pt);
+	cfg_ = next;
+	actions_.reset(cfg_);
+	config_generation_++;
+
+	if (next.vsync != prev.vsync)
+		this->apply_vsync();
+	if (next.music_volume != prev.music_volume)
+		music_->set_volume(next.music_volume);
+	if (next.frame_rate != prev.frame_rate || next.frame_spin_us != prev.frame_spin_us)
+		this->apply_frame_rate();
+	if (
+		next.window_width != prev.window_width ||
+		next.window_height != prev.window_height ||
+		next.window_fullscreen != prev.window_fullscreen ||
+		next.fov != prev.fov ||
+		next.z_near != prev.z_near ||
+		next.z_far != prev.z_far
+	) {
+		this->apply_window();
+	} else if (
+		next.dynamic_resolution != prev.dynamic_resolution ||
+		next.resolution_min != prev.resolution_min ||
+		next.resolution_max != prev.resolution_max ||
+		next.resolution_budget_us != prev.resolution_budget_us ||
+		next.frame_rate != prev.frame_rate
+	) {
+		this->apply_resolution();
+	}
+
+	if (
+		next.spike_budget_us != prev.spike_budget_us ||
+		next.spike_frames != prev.spike_frames ||
+		next.spike_cooldown != prev.spike_cooldown
+	) {
+		this->apply_flight_recorder();
+	}
+	if (next.latency_fence != prev.latency_fence)
+		this->apply_latency();
+	if (next.frame_latency != prev.frame_latency)
+		this->apply_frame_latency();
+	if (next.config_watch != prev.config_watch) {
+		// Turning the watch off stops further reloads; turning it
+		// back on has to be done by a restart.
+		this->apply_config_watch();
+	}
+
+	if (
+		next.tick_rate != prev.tick_rate ||
+		next.tick_lim != prev.tick_lim ||
+		next.pipelined != prev.pipelined ||
+		next.io_thread != prev.io_thread ||
+		next.metrics != prev.metrics ||
+		next.metrics_interval_ms != prev.metrics_interval_ms ||
+		next.job_workers != prev.job_workers
+	) {
+		PUP_LOG(warning) << "some of the changed settings require a restart";
+	}
+
+	PUP_LOG(info) << boost::format("pup::application::reload_config(): generation=%1%")
+		% config_generation_;
+}
+
+void application::apply_vsync()
+{
+	const unsigned int vsync = bench_frames_? 0: cfg_.vsync;
+
+	if (::SDL_GL_SetSwapInterval(vsync == 1) < 0) {
+		PUP_LOG(warning) << boost::format("failed to set v-sync: %1%")
+			% ::SDL_GetError();
+	}
+}
+
+void application::apply_frame_rate()
+{
+	frame_pacer_.set_rate(bench_frames_ || player_? 0.0: cfg_.frame_rate);
+	frame_pacer_.set_spin(cfg_.frame_spin_us * 1000);
+}
+
+void application::apply_flight_recorder()
+{
+	if (flight_recorder_.get_frames() != cfg_.spike_frames)
+		flight_recorder_.set_frames(cfg_.spike_frames);
+	flight_recorder_.set_budget(cfg_.spike_budget_us * 1000);
+	flight_recorder_.set_cooldown(static_cast<::Sint64>(cfg_.spike_cooldown * 1e9));
+}
 
-	if (width < 1 || height < 1)
-		PUP_ERR(std::runtime_error, "invalid window dimensions");
+void application::apply_latency()
+{
+	if (cfg_.latency_fence && !gl1::input_latency::fence_supported())
+		PUP_LOG(warning) << "input latency fences require sync objects";
+	input_latency_.set_fence(cfg_.latency_fence);
+}
+
+// Watch the config file for changes, except in benchmarks and
+// replays, which must not change behind their back.
+void application::apply_config_watch()
+{
+	if (cfg_.config_watch && !bench_frames_ && !player_) {
+		if (!config_watcher_)
+			config_watcher_.reset(new cfg::watcher(this->get_config_path()));
+	} else {
+		config_watcher_.reset();
+	}
+}
+
+// With graphics.frame_latency set to N, at most N frames are
+// queued on the GPU, see %gl1::frame_limiter.
+void application::apply_frame_latency()
+{
+	if (!cfg_.frame_latency) {
+		limiter_.reset();
+		return;
+	}
+
+	if (!gl1::frame_limiter::supported()) {
+		PUP_LOG(warning) << "limiting frame latency requires sync objects";
+		limiter_.reset();
+		return;
+	}
+
+	if (!limiter_)
+		limiter_.reset(new gl1::frame_limiter(cfg_.frame_latency));
+	else
+		limiter_->set_depth(cfg_.frame_latency);
+}
+
+// Resize the window and set up the viewport and the projection.
+void application::apply_window()
+{
+	const int width = cfg_.window_width;
+	const int height = cfg_.window_height;
 
 	::SDL_SetWindowSize(window_, width, height);
 	::SDL_SetWindowPosition(window_, SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED);
 	::glViewport(0, 0, width, height);
 	
-	::Uint32 fullscreen = pt_.get<bool>("graphics.window_fullscreen")?
+	::Uint32 fullscreen = !bench_frames_ && cfg_.window_fullscreen?
 		SDL_WINDOW_FULLSCREEN: 0;
 	
 	if (::SDL_SetWindowFullscreen(window_, fullscreen) != 0) {
@@ -259,18 +970,15 @@ void application::configure()
 		));
 	}
 	
-	const float fov = pt_.get<float>("graphics.fov");
 	const float ratio = static_cast<float>(width) / static_cast<float>(height);
-	const float z_near = pt_.get<float>("graphics.z_near");
-	const float z_far = pt_.get<float>("graphics.z_far");
 
 	::glMatrixMode(GL_PROJECTION);
 	::glLoadIdentity();
 	::gluPerspective(
-		fov,
+		cfg_.fov,
 		ratio,
-		z_near,
-		z_far
+		cfg_.z_near,
+		cfg_.z_far
 	);
 
 	::glMatrixMode(GL_MODELVIEW);
@@ -279,62 +987,602 @@ void application::configure()
 	::glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 	::glClear(GL_COLOR_BUFFER_BIT);
 
-	BOOST_LOG_TRIVIAL(info)	<< boost::format(
-		"pup::application::configure()\n"
-		"\tseed=%1%\n"
-		"\tw=%2%, h=%3%\n"
-		"\tfov=%4%, ratio=%5%, vsync=%6%, fullscreen=%7%\n"
-	)
-		% seed
-		% width
-		% height
-		% fov
-		% ratio
-		% vsync
-		% (fullscreen != 0);
+	this->apply_resolution();
+}
+
+// Set up the resolution scaler when dynamic resolution is
+// enabled. Without an explicit budget the scene gets the frame
+// period of graphics.frame_rate, or of 60 Hz.
+void application::apply_resolution()
+{
+	if (!cfg_.dynamic_resolution) {
+		scaler_.reset();
+		return;
+	}
+
+	if (!gl1::resolution_scaler::supported()) {
+		PUP_LOG(warning) << "dynamic resolution requires framebuffer objects";
+		scaler_.reset();
+		return;
+	}
+	if (!gl1::gpu_timer::supported()) {
+		PUP_LOG(warning) << "dynamic resolution requires timer queries,"
+			" rendering at graphics.resolution_max";
+	}
+
+	const ::Sint64 budget = cfg_.resolution_budget_us? cfg_.resolution_budget_us * 1000:
+		static_cast<::Sint64>(1e9 / (cfg_.frame_rate > 0.0? cfg_.frame_rate: 60.0));
+
+	if (!scaler_) {
+		scaler_.reset(new gl1::resolution_scaler(cfg_.resolution_min,
+			cfg_.resolution_max, budget));
+	} else {
+		scaler_->set_budget(budget);
+		scaler_->set_limits(cfg_.resolution_min, cfg_.resolution_max);
+	}
+	scaler_->resize(cfg_.window_width, cfg_.window_height);
 }
 
 void application::loop()
 {
 	this->configure();
 	this->queue_controller(this->get_start_controller());
-	
+
+	if (!cfg_.metrics.empty())
+		this->start_metrics();
+	if (io_threaded_)
+		this->start_io();
+
+	if (opt_vm_.count("record"))
+		recorder_.reset(new rec::recorder(opt_vm_["record"].as<std::string>(), seed_));
+
 	this->before_loop();
 
-	::SDL_Event event;
+	PUP_THREAD_NAME("main");
+
+	loop_start_ = hr_timer::now();
+	mem::end_alloc_frame();
 
 	while (loop_) {
-		timer_.update();
+		PUP_ZONE("application::loop");
+
+		profiler_.begin_frame();
+
+		// The simulation of the previous frame must be done before
+		// the timers, the controller queue or the controller state
+		// can be touched.
+		simulation_thread_.wait();
+		profiler_.add(prf::PHASE_THINK, think_ns_.exchange(0));
+		profiler_.add(prf::PHASE_THINK, think_counters_);
+		think_counters_.fill(0);
+
+		this->adopt_controllers();
+
+		if (config_watcher_ && config_watcher_->changed())
+			this->reload_config();
+
+		if (!this->update_timers()) {
+			PUP_LOG(info) << boost::format("replay finished after %1% frames")
+				% player_->get_frames();
+			this->stop();
+			break;
+		}
 
 		if (controller_queue_.empty() || !controller_queue_.front().get())
 			PUP_ERR(std::runtime_error, "missing controller");
 		
-		controller_queue_.front()->prepare();
-
-		while (
-			::SDL_PollEvent(&event) != 0 &&
-			::SDL_GetTicks() - timer_.last() <= event_tick_lim_
-		) {
-			if (event.type == SDL_QUIT || event.type == SDL_WINDOWEVENT_CLOSE) {
-				this->stop();
-				break;
-			}
-			if (controller_queue_.front()->react(event))
-				break;
+		controller_ptr ctrlr(controller_queue_.front());
+		const bool pipelined = pipelined_ && ctrlr->pipelined();
+		const bool late_input = cfg_.late_input && !pipelined && !player_ && !recorder_;
+		double alpha = alpha_;
+
+		if (pipelined)
+			ctrlr->publish();
+
+		ctrlr->prepare();
+
+		// With graphics.frame_latency set, wait for the GPU to catch
+		// up before input is sampled. Counted as part of the swap.
+		if (limiter_) {
+			limiter_->wait();
+			profiler_.add(prf::PHASE_AFTER_RENDER, limiter_->get_last_wait());
+		}
+
+		profiler_.begin(prf::PHASE_REACT);
+		event_span events(event_pump_.pump());
+		this->check_quit(events);
+		// Live input is ignored while replaying, except for requests
+		// to quit.
+		if (player_) {
+			events = event_pump_.replace(replay_frame_.events.data(),
+				replay_frame_.events.size());
+		}
+		if (recorder_)
+			recorder_->write(hr_timer_.delta(), timer_.delta(), events.begin(), events.size());
+		if (!events.empty())
+			ctrlr->react_batch(events);
+		if (!player_)
+			this->track_input(events);
+		profiler_.end(prf::PHASE_REACT);
+
+		this->update_background();
+
+		profiler_.begin(prf::PHASE_MISC);
+		this->poll_io();
+		profiler_.end(prf::PHASE_MISC);
+
+		// In pipelined mode the next simulation step runs while the
+		// state published above is rendered.
+		if (pipelined) {
+			simulation_thread_.run(boost::bind(&application::simulate,
+				this, boost::ref(*ctrlr)));
+		} else {
+			this->simulate(*ctrlr);
+			profiler_.add(prf::PHASE_THINK, think_ns_.exchange(0));
+			profiler_.add(prf::PHASE_THINK, think_counters_);
+			think_counters_.fill(0);
+			alpha = alpha_;
 		}
-		controller_queue_.front()->think();
 
-		this->before_render();
-		controller_queue_.front()->render();
-		this->after_render();
+		// Nothing is visible while minimized.
+		if (!minimized_) {
+			// Sample input once more right before rendering, see
+			// graphics.late_input. The simulation has already run,
+			// only what controllers apply in react() is affected.
+			if (late_input && loop_) {
+				profiler_.begin(prf::PHASE_REACT);
+				event_span late(event_pump_.pump(true));
+				this->check_quit(late);
+				if (!late.empty())
+					ctrlr->react_batch(late);
+				this->track_input(late);
+				profiler_.end(prf::PHASE_REACT);
+			}
 
+			profiler_.begin(prf::PHASE_BEFORE_RENDER);
+			this->before_render();
+			profiler_.end(prf::PHASE_BEFORE_RENDER);
+
+			profiler_.begin(prf::PHASE_RENDER);
+			if (scaler_)
+				scaler_->begin();
+			ctrlr->render_interpolated(alpha);
+			if (scaler_)
+				scaler_->end();
+			ctrlr->render_overlay();
+			profiler_.end(prf::PHASE_RENDER);
+
+			profiler_.begin(prf::PHASE_AFTER_RENDER);
+			this->after_render();
+			profiler_.end(prf::PHASE_AFTER_RENDER);
+		} else {
+			input_latency_.discard();
+			mem::frame_arena().reset();
+		}
+
+		profiler_.begin(prf::PHASE_MISC);
 		if (misc_interval_.expired())
 			this->misc();
-		if (controller_queue_.size() > 1)
+		profiler_.end(prf::PHASE_MISC);
+
+		if (controller_queue_.size() > 1) {
+			simulation_thread_.wait();
 			controller_queue_.pop();
+		}
+
+		if (background_)
+			this->wait_background();
+		else
+			frame_pacer_.wait();
+		profiler_.end_frame();
+
+		alloc_frame_ = mem::end_alloc_frame();
+		alloc_loop_.allocs += alloc_frame_.allocs;
+		alloc_loop_.frees += alloc_frame_.frees;
+		alloc_loop_.bytes += alloc_frame_.bytes;
+		alloc_loop_.peak_live = std::max(alloc_loop_.peak_live, alloc_frame_.peak_live);
+
+		this->record_frame(*ctrlr);
+
+		if (bench_frames_ && rendered_frames_ >= bench_frames_)
+			this->stop();
+	}
+
+	simulation_thread_.wait();
+	recorder_.reset();
+
+	if (bench_frames_)
+		this->write_bench();
+	if (opt_vm_.count("profile-dump"))
+		profiler_.write_csv(opt_vm_["profile-dump"].as<std::string>());
+	if (opt_vm_.count("trace-out")) {
+#ifdef PUP_TRACE
+		prf::write_trace(opt_vm_["trace-out"].as<std::string>());
+#else
+		PUP_LOG(warning) << "trace requested, but zones are compiled out"
+			" (build with PUP_TRACE defined)";
+#endif
+	}
+	if (opt_vm_.count("alloc-report")) {
+		std::ofstream ofs(opt_vm_["alloc-report"].as<std::string>());
+		mem::write_alloc_report(ofs);
+	} else if (mem::alloc_tracking()) {
+		std::ostringstream ostr;
+		mem::write_alloc_report(ostr);
+		log::write(boost::log::trivial::info, ostr.str());
+	}
+	if (input_latency_.get_swap_latency().get_total()) {
+		const prf::latency_stats swap(input_latency_.get_swap_latency().get_stats());
+		const prf::latency_stats gpu(input_latency_.get_gpu_latency().get_stats());
+		PUP_LOG(info) << boost::format("input latency: swap min=%1$.2fms avg=%2$.2fms p99=%3$.2fms,"
+			" gpu min=%4$.2fms avg=%5$.2fms p99=%6$.2fms")
+			% (swap.min / 1e6) % (swap.mean / 1e6) % (swap.p99 / 1e6)
+			% (gpu.min / 1e6) % (gpu.mean / 1e6) % (gpu.p99 / 1e6);
 	}
 
 	this->after_loop();
+	this->stop_io();
+	this->stop_metrics();
+}
+
+// Advance the simulation of the current controller. With a
+// tick rate set, %controller::think() is called once per elapsed
+// tick (at most tick_lim_ times per frame, any further backlog
+// is dropped) and the fraction of a tick left over is kept as
+// the interpolation factor for rendering.
+void application::simulate(controller& ctrlr)
+{
+	PUP_ZONE("application::simulate");
+
+	// The counters of the thread running the simulation, which is
+	// not the main thread in pipelined mode.
+	prf::hw_counters* counters = profiler_.has_counters()? &prf::hw_counters::local(): nullptr;
+	prf::counter_values counts_before;
+	if (counters)
+		counters->read(counts_before);
+
+	const ::Sint64 start = prf::now();
+
+	if (!tick_rate_) {
+		ctrlr.think();
+		alpha_ = 1.0;
+	} else {
+		const ::Sint64 tick_ns = 1000000000ll / tick_rate_;
+		::Uint32 ticks = 0;
+
+		// Benchmarks advance exactly one tick per frame, making the
+		// amount of simulation independent of the frame rate.
+		tick_accumulator_ += bench_frames_? tick_ns: hr_timer_.delta();
+		while (tick_accumulator_ >= tick_ns && ticks < tick_lim_) {
+			ctrlr.think();
+			tick_accumulator_ -= tick_ns;
+			++ticks;
+		}
+		if (tick_accumulator_ >= tick_ns)
+			tick_accumulator_ %= tick_ns;
+
+		alpha_ = static_cast<double>(tick_accumulator_) / tick_ns;
+	}
+
+	think_ns_ += prf::now() - start;
+
+	if (counters) {
+		prf::counter_values counts_after;
+		counters->read(counts_after);
+		for (int c = 0; c < prf::COUNTER_COUNT; ++c)
+			think_counters_[c] += counts_after[c] - counts_before[c];
+	}
+
+	if (std::this_thread::get_id() != main_thread_id_)
+		mem::frame_arena().reset();
+}
+
+// Advance the timers by the elapsed time or, when replaying, by
+// the time recorded for the frame. Unless replaying as fast as
+// possible, replayed frames are held back until the recorded
+// time has passed. False once the recording is exhausted.
+bool application::update_timers()
+{
+	if (!player_) {
+		timer_.update();
+		hr_timer_.update();
+		return true;
+	}
+
+	if (!player_->next(replay_frame_))
+		return false;
+
+	timer_.advance(replay_frame_.tick_delta);
+	hr_timer_.advance(replay_frame_.hr_delta);
+
+	if (!replay_fast_)
+		frame_pacer::sleep_until(hr_timer_.last(), frame_pacer_.get_spin());
+	return true;
+}
+
+// Stop on a request to quit, dropping the events after it.
+void application::check_quit(event_span& events)
+{
+	for (auto it = events.begin(); it != events.end(); ++it) {
+		if (it->type == SDL_QUIT || (
+			it->type == SDL_WINDOWEVENT &&
+			it->window.event == SDL_WINDOWEVENT_CLOSE
+		)) {
+			events.count = it - events.begin();
+			this->stop();
+			break;
+		}
+	}
+}
+
+static bool is_input(const ::SDL_Event& event) throw()
+{
+	switch (event.type) {
+	case SDL_KEYDOWN:
+	case SDL_KEYUP:
+	case SDL_TEXTINPUT:
+	case SDL_MOUSEMOTION:
+	case SDL_MOUSEBUTTONDOWN:
+	case SDL_MOUSEBUTTONUP:
+	case SDL_MOUSEWHEEL:
+	case SDL_JOYAXISMOTION:
+	case SDL_JOYHATMOTION:
+	case SDL_JOYBUTTONDOWN:
+	case SDL_JOYBUTTONUP:
+	case SDL_CONTROLLERAXISMOTION:
+	case SDL_CONTROLLERBUTTONDOWN:
+	case SDL_CONTROLLERBUTTONUP:
+	case SDL_FINGERDOWN:
+	case SDL_FINGERUP:
+	case SDL_FINGERMOTION:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// SDL timestamps events in milliseconds of SDL_GetTicks(), they
+// are placed on the %prf::now() timeline by their age. Fences of
+// earlier frames are polled here and after the swap.
+void application::track_input(const event_span& events)
+{
+	input_latency_.poll();
+
+	const ::Sint64 now = prf::now();
+	const ::Uint32 ticks = ::SDL_GetTicks();
+	for (auto it = events.begin(); it != events.end(); ++it) {
+		if (is_input(*it))
+			input_latency_.input(now - static_cast<::Sint64>(ticks - it->common.timestamp) * 1000000);
+	}
+}
+
+// Keep the frame that just ended in the flight recorder and pass
+// it on to the metrics server, if any. When the frame took longer
+// than general.spike_budget_us, the recorded frames are written as
+// JSON to general.spike_dir on the job system, at most once per
+// general.spike_cooldown seconds. Frames in the background are
+// expected to be long and never count as spikes.
+void application::record_frame(const controller& ctrlr)
+{
+	prf::flight_frame frame;
+
+	frame.end = prf::now();
+	for (int p = 0; p < prf::PHASE_COUNT; ++p)
+		frame.phases[p] = profiler_.get_last(static_cast<prf::phase>(p));
+	frame.events_received = event_pump_.get_frame_received();
+	frame.events_delivered = event_pump_.get_frame_delivered();
+	frame.allocs = alloc_frame_.allocs;
+	frame.alloc_bytes = alloc_frame_.bytes;
+	if (scaler_) {
+		frame.gpu_ns = scaler_->get_gpu_time();
+		frame.resolution_scale = scaler_->get_scale();
+	}
+	if (!minimized_)
+		frame.input_latency = input_latency_.get_frame_max();
+	std::strncpy(frame.controller, ctrlr.get_name(), sizeof(frame.controller) - 1);
+	frame.controller[sizeof(frame.controller) - 1] = '\0';
+
+	if (metrics_) {
+		mtr::sample s;
+		s.frame = frame;
+		s.missed = frame_pacer_.get_missed();
+		s.rendered = rendered_frames_;
+		s.peak_live = alloc_frame_.peak_live;
+		s.arena_peak = mem::frame_arena().get_peak();
+		s.music_playing = music_->playing();
+		s.music_volume = music_->get_volume();
+		metrics_->push(s);
+	}
+
+	if (!flight_recorder_.record(frame, !background_ && !bench_frames_))
+		return;
+
+	std::shared_ptr<prf::flight_recorder::frame_vector> frames(
+		new prf::flight_recorder::frame_vector());
+	flight_recorder_.snapshot(*frames);
+
+	const ::Sint64 budget = flight_recorder_.get_budget();
+	const boost::filesystem::path path(boost::filesystem::path(cfg_.spike_dir)
+		/ boost::str(boost::format("spike-%1%.json") % frames->back().index));
+
+	PUP_LOG(warning) << boost::format("frame took %1$.2fms, writing %2% frames to \"%3%\"")
+		% (frame.phases[prf::PHASE_FRAME] / 1e6)
+		% frames->size()
+		% path.string();
+
+	job_system_->submit([frames, path, budget]() {
+		prf::flight_recorder::write_json(path, *frames, budget);
+	});
+}
+
+// Unless general.background_rate is 0, the loop is throttled to
+// that rate while the window has no input focus, and rendering is
+// skipped while the window is minimized or hidden. The simulation,
+// io and misc() (and with it the jukebox) keep running. Benchmarks
+// and replays are never throttled.
+void application::update_background()
+{
+	const bool enabled = cfg_.background_rate > 0.0 && !bench_frames_ && !player_;
+	const ::Uint32 flags = ::SDL_GetWindowFlags(window_);
+
+	const bool background = enabled && !(flags & SDL_WINDOW_INPUT_FOCUS);
+	minimized_ = enabled && (flags & (SDL_WINDOW_MINIMIZED | SDL_WINDOW_HIDDEN));
+
+	if (background == background_)
+		return;
+
+	background_ = background;
+	PUP_LOG(info) << (background_? "throttling in the background": "resuming from the background");
+
+	// The pacer must not count the time spent in the background
+	// as missed frames.
+	if (!background_)
+		this->apply_frame_rate();
+}
+
+// Block until the next background frame is due, or until an event
+// arrives, instead of sleeping and spinning like the pacer.
+void application::wait_background()
+{
+	const ::Sint64 period = static_cast<::Sint64>(1e9 / cfg_.background_rate);
+	const ::Sint64 remaining = hr_timer_.last() + period - hr_timer::now();
+
+	if (remaining > 0)
+		::SDL_WaitEventTimeout(nullptr, static_cast<int>((remaining + 999999) / 1000000));
+}
+
+// Run ready io_service handlers on the main thread until the
+// per-frame budget is used up. Does nothing when the io_service
+// is run by a background thread.
+void application::poll_io()
+{
+	if (io_thread_.joinable())
+		return;
+
+	if (io_service_.stopped())
+		io_service_.reset();
+
+	const ::Sint64 deadline = hr_timer::now() + io_budget_;
+	while (io_service_.poll_one() && hr_timer::now() < deadline)
+		;
+}
+
+void application::start_io()
+{
+	if (io_thread_.joinable())
+		return;
+
+	io_service_.reset();
+	io_work_.reset(new boost::asio::io_service::work(io_service_));
+	io_thread_ = std::thread([this]() {
+		for (;;) {
+			try {
+				io_service_.run();
+				break;
+			}
+			catch (const std::exception& e) {
+				PUP_LOG(error) << boost::format("io handler failed: %1%")
+					% e.what();
+			}
+		}
+	});
+}
+
+void application::stop_io() throw()
+{
+	if (!io_thread_.joinable())
+		return;
+
+	io_work_.reset();
+	io_service_.stop();
+	io_thread_.join();
+}
+
+// The metrics are serialized and sent on a thread with its own
+// io_service. Neither the main thread nor the handlers queued on
+// %get_io_service() ever wait for them, and general.io_thread
+// alone decides where those handlers run.
+void application::start_metrics()
+{
+	if (metrics_thread_.joinable())
+		return;
+
+	metrics_io_.reset();
+	metrics_.reset(new mtr::server(metrics_io_, cfg_.metrics,
+		cfg_.metrics_interval_ms * 1000000));
+	metrics_thread_ = std::thread([this]() {
+		PUP_THREAD_NAME("metrics");
+		for (;;) {
+			try {
+				metrics_io_.run();
+				break;
+			}
+			catch (const std::exception& e) {
+				PUP_LOG(error) << boost::format("metrics handler failed: %1%")
+					% e.what();
+			}
+		}
+	});
+}
+
+void application::stop_metrics() throw()
+{
+	if (metrics_thread_.joinable()) {
+		metrics_io_.stop();
+		metrics_thread_.join();
+	}
+	metrics_.reset();
+}
+
+// Write the frame time statistics of a benchmark run as JSON,
+// to the path given by --bench-out or to the log.
+void application::write_bench()
+{
+	boost::property_tree::ptree bench;
+
+	bench.put("application", application_name());
+	bench.put("version", application_version());
+	const double seconds = (hr_timer::now() - loop_start_) / 1e9;
+
+	bench.put("frames", rendered_frames_);
+	bench.put("seconds", seconds);
+	bench.put("fps", rendered_frames_ / seconds);
+
+	for (int p = 0; p < prf::PHASE_COUNT; ++p) {
+		const prf::phase phase = static_cast<prf::phase>(p);
+		const prf::phase_stats stats(profiler_.get_stats(phase));
+		const std::string key(std::string("phases.") + prf::phase_name(phase));
+
+		bench.put(key + ".mean_ms", stats.mean / 1e6);
+		bench.put(key + ".p50_ms", stats.p50 / 1e6);
+		bench.put(key + ".p95_ms", stats.p95 / 1e6);
+		bench.put(key + ".p99_ms", stats.p99 / 1e6);
+		bench.put(key + ".max_ms", stats.max / 1e6);
+
+		if (profiler_.has_counters()) {
+			const prf::counter_stats counts(profiler_.get_counter_stats(phase));
+			for (int c = 0; c < prf::COUNTER_COUNT; ++c) {
+				bench.put(key + "." + prf::counter_name(static_cast<prf::counter>(c)),
+					counts.per_frame[c]);
+			}
+			bench.put(key + ".ipc", counts.ipc);
+		}
+	}
+
+	if (mem::alloc_tracking() && rendered_frames_) {
+		bench.put("allocations.per_frame", static_cast<double>(alloc_loop_.allocs) / rendered_frames_);
+		bench.put("allocations.bytes_per_frame", static_cast<double>(alloc_loop_.bytes) / rendered_frames_);
+		bench.put("allocations.peak_live", alloc_loop_.peak_live);
+	}
+
+	if (opt_vm_.count("bench-out")) {
+		boost::property_tree::json_parser::write_json(
+			opt_vm_["bench-out"].as<std::string>(), bench);
+	} else {
+		std::ostringstream ostr;
+		boost::property_tree::json_parser::write_json(ostr, bench);
+		log::write(boost::log::trivial::info, ostr.str());
+	}
 }
 
 void application::misc()
@@ -349,20 +1597,29 @@ void application::before_render()
 void application::after_render()
 {
 	::SDL_GL_SwapWindow(window_);
+	input_latency_.swapped(prf::now());
+	if (limiter_)
+		limiter_->swapped();
 	
 	frame_count_++;
 	frames_per_second_ = static_cast<::Uint32>(
-		++rendered_frames_ / timer_.total_sec()
+		++rendered_frames_ / hr_timer_.total_sec()
 	);
+
+	if (rendered_frames_ == 1) {
+		PUP_LOG(info) << boost::format("first frame after %1$.2fms")
+			% ((prf::now() - startup_begin_) / 1e6);
+	}
 	
 	if (status_interval_.test_expired()) {
 		::SDL_SetWindowTitle(
 			window_,
-			boost::str(boost::format("%1% [approx_fps=%2%, avg_fps=%3%, frames=%4%, ctrlr=%5%]")
+			boost::str(boost::format("%1% [approx_fps=%2%, avg_fps=%3%, frames=%4%, missed=%5%, ctrlr=%6%]")
 				% application_name()
 				% frame_count_
 				% frames_per_second_
 				% rendered_frames_
+				% frame_pacer_.get_missed()
 				% controller_queue_.front()->get_name()
 			).c_str()
 		);
@@ -371,8 +1628,7 @@ void application::after_render()
 		status_interval_.renew();
 	}
 
-	if (frame_delay_)
-		::SDL_Delay(frame_delay_);
+	mem::frame_arena().reset();
 }
 
 void application::before_loop()
@@ -398,10 +1654,77 @@ controller_ptr application::get_current_controller()
 	return controller_queue_.front();
 }
 
+// Controllers queued from another thread than the main thread,
+// e.g. from think() in pipelined mode, are initialized by the
+// main thread at the start of the next frame.
 void application::queue_controller(controller_ptr ctrlr)
 {
+	if (std::this_thread::get_id() != main_thread_id_) {
+		std::lock_guard<std::mutex> lock(pending_mutex_);
+		pending_controllers_.push(ctrlr);
+		return;
+	}
 	controller_queue_.push(ctrlr);
 	ctrlr->init();
 }
 
+// Load a controller on the job system while the current (or the
+// given loading) controller keeps rendering. Once load() is done
+// the controller is uploaded, initialized and queued by the main
+// thread, replacing the current controller after the next frame.
+void application::queue_controller_async(controller_ptr ctrlr, controller_ptr loading)
+{
+	if (std::this_thread::get_id() != main_thread_id_)
+		PUP_ERR(std::logic_error, "asynchronous loads must be queued from the main thread");
+
+	async_load l = {
+		ctrlr,
+		std::make_shared<job::counter>(),
+		std::make_shared<std::exception_ptr>()
+	};
+
+	ctrlr->set_progress(0.0f);
+	async_loads_.push_back(l);
+
+	if (loading)
+		this->queue_controller(loading);
+
+	std::shared_ptr<std::exception_ptr> error(l.error);
+	this->get_job_system().submit([ctrlr, error]() {
+		try {
+			ctrlr->load();
+			ctrlr->set_progress(1.0f);
+		}
+		catch (...) {
+			*error = std::current_exception();
+		}
+	}, l.done.get());
+}
+
+controller_ptr application::get_pending_controller()
+{
+	return async_loads_.empty()? controller_ptr(): async_loads_.front().ctrlr;
+}
+
+void application::adopt_controllers()
+{
+	controller_queue pending;
+	{
+		std::lock_guard<std::mutex> lock(pending_mutex_);
+		std::swap(pending, pending_controllers_);
+	}
+	for (; !pending.empty(); pending.pop())
+		this->queue_controller(pending.front());
+
+	// Asynchronous loads are adopted in the order they were queued.
+	while (!async_loads_.empty() && async_loads_.front().done->done()) {
+		async_load l(async_loads_.front());
+		async_loads_.pop_front();
+		if (*l.error)
+			std::rethrow_exception(*l.error);
+		l.ctrlr->upload();
+		this->queue_controller(l.ctrlr);
+	}
+}
+
 } // pup
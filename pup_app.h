@@ -42,7 +42,14 @@
 #include "pup_env.h"
 #include "pup_core.h"
 
+#include "pup_cfg.h"
 #include "pup_gl1.h"
+#include "pup_job.h"
+#include "pup_log.h"
+#include "pup_mem.h"
+#include "pup_mtr.h"
+#include "pup_prf.h"
+#include "pup_rec.h"
 #include "pup_snd.h"
 
 namespace pup {
@@ -65,6 +72,15 @@ public:
 		last_tick_ = current_tick_;
 	}
 
+	// Advance by a given delta instead of the elapsed time, used
+	// when replaying a session.
+	inline void advance(::Uint32 delta) throw()
+	{
+		current_tick_ = last_tick_ + delta;
+		tick_delta_ = delta;
+		last_tick_ = current_tick_;
+	}
+
 	inline ::Uint32 delta() const throw() { return tick_delta_; }
 	inline ::Uint32 last() const throw() { return last_tick_; }
 	inline ::Uint32 total() const throw() { return last_tick_ - first_tick_; }
@@ -137,15 +153,282 @@ private:
 	
 };
 
+// A monotonic nanosecond timer driven by the performance
+// counter. Unlike %timer it neither wraps nor quantizes deltas
+// to whole milliseconds.
+class hr_timer
+{
+public:
+	explicit hr_timer(const ::Sint64& ns = hr_timer::now()) throw() :
+		first_ns_(ns),
+		current_ns_(ns),
+		last_ns_(ns),
+		ns_delta_(0)
+	{}
+
+	// Nanoseconds since an arbitrary, fixed point in time.
+	static inline ::Sint64 now() throw()
+	{
+		static const ::Uint64 freq = ::SDL_GetPerformanceFrequency();
+		const ::Uint64 count = ::SDL_GetPerformanceCounter();
+		return static_cast<::Sint64>(
+			(count / freq) * 1000000000ull +
+			(count % freq) * 1000000000ull / freq
+		);
+	}
+
+	inline void update() throw()
+	{
+		current_ns_ = hr_timer::now();
+		ns_delta_ = current_ns_ - last_ns_;
+		last_ns_ = current_ns_;
+	}
+
+	inline void advance(::Sint64 delta) throw()
+	{
+		current_ns_ = last_ns_ + delta;
+		ns_delta_ = delta;
+		last_ns_ = current_ns_;
+	}
+
+	inline ::Sint64 delta() const throw() { return ns_delta_; }
+	inline ::Sint64 last() const throw() { return last_ns_; }
+	inline ::Sint64 total() const throw() { return last_ns_ - first_ns_; }
+
+	inline double delta_sec() const throw() { return this->delta() / 1e9; }
+	inline double last_sec() const throw() { return this->last() / 1e9; }
+	inline double total_sec() const throw() { return this->total() / 1e9; }
+
+	inline double delta_ms() const throw() { return this->delta() / 1e6; }
+	inline double total_ms() const throw() { return this->total() / 1e6; }
+
+private:
+	::Sint64 first_ns_;
+	::Sint64 current_ns_;
+	::Sint64 last_ns_;
+	::Sint64 ns_delta_;
+};
+
+// Detect time intervals with nanosecond precision. Deltas are
+// ::Sint64 nanoseconds or double seconds. A plain int does not
+// compile, unlike %interval, which takes it as milliseconds.
+class hr_interval :
+	private boost::noncopyable
+{
+public:
+	explicit hr_interval(hr_timer& t, const ::Sint64 d) throw() :
+		timer_(t),
+		ns_(t.last()),
+		delta_(d)
+	{}
+
+	explicit hr_interval(hr_timer& t, const double d) throw() :
+		hr_interval(t, static_cast<::Sint64>(d * 1e9))
+	{}
+
+	inline bool test_expired() const throw()
+	{
+		return timer_.last() >= ns_ + delta_;
+	}
+
+	inline bool expired() throw()
+	{
+		if (this->test_expired()) {
+			this->renew();
+			return true;
+		}
+		return false;
+	}
+
+	inline void renew() throw() { ns_ = timer_.last(); }
+
+	inline void set_delta(double d) throw() { delta_ = static_cast<::Sint64>(d * 1e9); }
+	inline void set_delta(::Sint64 d) throw() { delta_ = d; }
+
+	inline double delta_sec() const throw() { return delta_ / 1e9; }
+	inline ::Sint64 delta() const throw() { return delta_; }
+
+	inline double remaining_sec() const throw() { return this->remaining() / 1e9; }
+	inline ::Sint64 remaining() const throw()
+	{
+		const ::Sint64 diff = ns_ + delta_ - timer_.last();
+		return diff < 0? 0: diff;
+	}
+
+private:
+	hr_timer& timer_;
+	::Sint64 ns_;
+	::Sint64 delta_;
+};
+
+// Keeps frames at a target rate. The bulk of the remaining
+// frame budget is slept away and the last fraction is spent
+// spinning, since sleeping overshoots by the granularity of
+// the scheduler. A frame finishing after its deadline counts
+// as missed and restarts the cadence from the current time.
+class frame_pacer :
+	private boost::noncopyable
+{
+public:
+	explicit frame_pacer(double rate = 0.0, ::Sint64 spin = 1000000) throw();
+
+	void wait() throw();
+	void reset() throw();
+
+	// Sleep and then spin for the last spin nanoseconds until
+	// %hr_timer::now() reaches the deadline.
+	static void sleep_until(::Sint64 deadline, ::Sint64 spin) throw();
+
+	void set_rate(double rate) throw();
+	double get_rate() const throw() { return rate_; }
+	bool enabled() const throw() { return period_ != 0; }
+
+	void set_spin(::Sint64 ns) throw() { spin_ = ns < 0? 0: ns; }
+	::Sint64 get_spin() const throw() { return spin_; }
+
+	::Sint64 get_period() const throw() { return period_; }
+
+	::Uint32 get_missed() const throw() { return missed_; }
+	::Sint64 get_last_miss() const throw() { return last_miss_; }
+
+private:
+	double rate_;
+	::Sint64 period_;
+	::Sint64 spin_;
+	::Sint64 deadline_;
+	::Sint64 last_miss_;
+	::Uint32 missed_;
+};
+
+// A contiguous range of events, valid until the next time the
+// owning %event_pump is pumped.
+struct event_span
+{
+	explicit event_span(::SDL_Event* f = nullptr, size_type n = 0) throw() :
+		first(f),
+		count(n)
+	{}
+
+	inline ::SDL_Event* begin() const throw() { return first; }
+	inline ::SDL_Event* end() const throw() { return first + count; }
+
+	inline size_type size() const throw() { return count; }
+	inline bool empty() const throw() { return count == 0; }
+
+	::SDL_Event* first;
+	size_type count;
+};
+
+// Pulls all pending events from SDL in one go and coalesces
+// redundant ones. Consecutive mouse motion events from the same
+// device are merged into one event with the accumulated relative
+// motion, the timestamp of the first and the position of the
+// last. Only the last resize event of each kind per window is
+// kept.
+class event_pump :
+	private boost::noncopyable
+{
+public:
+	explicit event_pump(size_type capacity = 256);
+
+	// A pump later in the same frame, e.g. to sample input right
+	// before rendering, adds to the counts of the frame.
+	event_span pump(bool same_frame = false);
+
+	// Replace the events of the last pump, e.g. with replayed ones.
+	event_span replace(const ::SDL_Event* events, size_type n);
+
+	void set_capacity(size_type capacity);
+	size_type get_capacity() const throw() { return events_.size(); }
+
+	// Events pulled from SDL and events left after coalescing,
+	// for the last pump and in total.
+	size_type get_frame_received() const throw() { return frame_received_; }
+	size_type get_frame_delivered() const throw() { return frame_delivered_; }
+	::Uint64 get_received() const throw() { return received_; }
+	::Uint64 get_delivered() const throw() { return delivered_; }
+
+	static size_type coalesce(::SDL_Event* events, size_type n) throw();
+
+private:
+	std::vector<::SDL_Event> events_;
+	size_type frame_received_;
+	size_type frame_delivered_;
+	::Uint64 received_;
+	::Uint64 delivered_;
+};
+
+// A key and the modifiers held with it, written as e.g.
+// "ctrl+shift+s" in the config. Left and right modifiers are
+// not told apart and lock keys are ignored.
+struct key_chord
+{
+	enum {
+		MOD_CTRL = 1 << 0,
+		MOD_SHIFT = 1 << 1,
+		MOD_ALT = 1 << 2,
+		MOD_GUI = 1 << 3,
+		MOD_COMBINATIONS = 1 << 4
+	};
+
+	key_chord(::SDL_Scancode s = SDL_SCANCODE_UNKNOWN, unsigned int m = 0) throw() :
+		scancode(s),
+		mods(m)
+	{
+	}
+
+	// Map SDL modifier state to a mask of MOD_* bits.
+	static unsigned int mods_of(::Uint16 keymod) throw();
+
+	// The modifiers of a chord as "ctrl+alt+", empty if none.
+	static std::string mods_name(unsigned int mods);
+
+	static key_chord parse(const std::string& text);
+
+	::SDL_Scancode scancode;
+	unsigned int mods;
+};
+
+// Named actions bound to one or more comma separated chords,
+// e.g. "menu.quit=escape, ctrl+q". An action is parsed the
+// first time it is looked up after the config was (re)loaded.
+// The values of the config are copied, so that actions can be
+// looked up by any thread while the main thread reloads it.
+class action_map :
+	private boost::noncopyable
+{
+public:
+	typedef std::vector<key_chord> chord_vector;
+
+	explicit action_map(const cfg::config& config);
+	~action_map() throw();
+
+	// Throws if the action is missing or names an invalid key.
+	chord_vector find(const std::string& action);
+
+	// Take the values of a changed config and forget the parsed
+	// actions.
+	void reset(const cfg::config& config);
+
+private:
+	typedef std::map<std::string, chord_vector> chord_map;
+
+	cfg::config::value_map values_;
+	chord_map actions_;
+	std::mutex mutex_;
+};
+
 // Responsible for handling key rebindings and dispatching
-// key presses to appropriate controller callbacks. Modifiers
-// are currently not supported.
+// key presses to appropriate controller callbacks. Callbacks
+// are looked up in a table indexed by scancode and modifiers,
+// a key bound without modifiers also fires while modifiers are
+// held unless a chord claims that combination. Bindings are
+// resolved again when the config has been reloaded.
 class key_dispatcher :
 	private boost::noncopyable
 {
 public:
 	typedef boost::function<bool (::SDL_Event& event)> key_function;
-	typedef std::map<::SDL_Keycode, key_function> dispatch_map;
 
 	explicit key_dispatcher(application& app);
 	~key_dispatcher() throw();
@@ -155,9 +438,84 @@ public:
 
 	bool handle(::SDL_Event& event);
 
+	void rebind();
+
 private:
+	struct binding
+	{
+		key_function func;
+		std::string name;
+		std::string section;
+	};
+
+	// Slots hold an index into %bindings_ plus one, zero is
+	// unbound.
+	typedef std::vector<::Uint16> dispatch_table;
+
+	void bind(size_type index, const binding& b);
+
 	application& app_;
-	dispatch_map dispatch_map_;
+	dispatch_table table_;
+	std::vector<binding> bindings_;
+	unsigned int generation_;
+};
+
+// Runs tasks one at a time on a dedicated thread. Used to
+// overlap simulation with rendering in pipelined mode. An
+// exception thrown by a task is rethrown by %wait().
+class simulation_thread :
+	private boost::noncopyable
+{
+public:
+	typedef boost::function<void ()> task_function;
+
+	simulation_thread();
+	~simulation_thread() throw();
+
+	void run(const task_function& task);
+	void wait();
+
+	bool busy() throw();
+
+private:
+	void work();
+
+	std::thread thread_;
+	std::mutex mutex_;
+	std::condition_variable cond_;
+	task_function task_;
+	std::exception_ptr error_;
+	bool busy_;
+	bool quit_;
+};
+
+// Simulation state shared between a simulation thread writing
+// %back() and a render thread reading %front(). The owner must
+// make sure that %publish() is only called when neither side
+// is using the buffers, see %controller::publish().
+template <class T>
+class double_buffer
+{
+public:
+	double_buffer() :
+		front_(),
+		back_()
+	{}
+
+	explicit double_buffer(const T& v) :
+		front_(v),
+		back_(v)
+	{}
+
+	inline T& back() throw() { return back_; }
+	inline const T& back() const throw() { return back_; }
+	inline const T& front() const throw() { return front_; }
+
+	inline void publish() { front_ = back_; }
+
+private:
+	T front_;
+	T back_;
 };
 
 // The controller is responsible for handling application
@@ -174,10 +532,46 @@ public:
 	virtual void init() {}
 	virtual void prepare() {}
 
+	// Asynchronous loading, see %application::queue_controller_async().
+	// load() runs on a job system worker and must not touch GL,
+	// upload() runs on the main thread after load() has returned
+	// and before init(). Progress in [0, 1] may be reported from
+	// load() for the benefit of a loading controller.
+	virtual void load() {}
+	virtual void upload() {}
+
+	float get_progress() const throw() { return progress_; }
+	void set_progress(float p) throw() { progress_ = p; }
+
 	virtual bool react(::SDL_Event& event);
 	virtual void think() = 0;
 	virtual void render() = 0;
 
+	// Deliver all events of a frame at once. The default calls
+	// react() for every event and returns the number of events
+	// consumed.
+	virtual size_type react_batch(const event_span& events);
+
+	// Render with the given interpolation factor in [0, 1] between
+	// the previous and the current simulation tick. Only meaningful
+	// in fixed-timestep mode, see %application::simulate(). The
+	// default ignores the factor and calls render().
+	virtual void render_interpolated(double /* alpha */) { this->render(); }
+
+	// Called after render() at the native window resolution, also
+	// when the scene is rendered at a reduced resolution, see
+	// %gl1::resolution_scaler. Meant for the user interface.
+	virtual void render_overlay() {}
+
+	// Controllers that return true may have think() run on a
+	// simulation thread concurrently with render() when the
+	// application is configured as pipelined. publish() is then
+	// called on the main thread while the simulation is idle and
+	// should hand the latest simulation state over to render(),
+	// typically through a %double_buffer.
+	virtual bool pipelined() const throw() { return false; }
+	virtual void publish() {}
+
 	virtual const char* get_name() const throw() = 0;
 
 	virtual application& get_app() { return app_; }
@@ -188,6 +582,7 @@ protected:
 	application& app_;
 	key_dispatcher key_dispatcher_;
 	gl1::d3::view view_;
+	std::atomic<float> progress_;
 };
 
 typedef std::shared_ptr<controller> controller_ptr;
@@ -203,7 +598,10 @@ public:
 	virtual ~application() throw();
 
 	virtual void configure();
+	virtual void reload_config();
 	virtual void loop();
+	virtual void simulate(controller& ctrlr);
+	virtual void poll_io();
 	virtual void misc();
 
 	virtual void before_render();
@@ -218,12 +616,78 @@ public:
 	snd::jukebox& get_jukebox() throw() { return *jukebox_; }
 	snd::soundboard& get_soundboard() throw() { return *soundboard_; }
 
+	// Millisecond timer, kept for compatibility. Frame timing is
+	// driven by the high-resolution timer.
 	timer& get_timer() throw() { return timer_; }
+	hr_timer& get_hr_timer() throw() { return hr_timer_; }
+	event_pump& get_event_pump() throw() { return event_pump_; }
+	prf::frame_profiler& get_profiler() throw() { return profiler_; }
+	prf::flight_recorder& get_flight_recorder() throw() { return flight_recorder_; }
+
+	// Null unless general.metrics is set. The server runs on a
+	// thread of its own, not on %get_io_service().
+	mtr::server* get_metrics() throw() { return metrics_.get(); }
+
+	// The heap allocations of the most recent frame and of the
+	// whole loop, always zero unless built with PUP_TRACK_ALLOC.
+	const mem::alloc_stats& get_alloc_frame() const throw() { return alloc_frame_; }
+	const mem::alloc_stats& get_alloc_loop() const throw() { return alloc_loop_; }
+
+	// The frame arena of the main thread, see %mem::frame_arena().
+	mem::arena& get_frame_arena() throw() { return mem::frame_arena(); }
+
+	// Null unless graphics.dynamic_resolution is enabled.
+	gl1::resolution_scaler* get_resolution_scaler() throw() { return scaler_.get(); }
+
+	// Input to swap latency and, with graphics.latency_fence, input
+	// to GPU done latency of the events delivered to controllers.
+	// Replayed events are not measured.
+	const gl1::input_latency& get_input_latency() const throw() { return input_latency_; }
+
+	// Null unless graphics.frame_latency is set.
+	gl1::frame_limiter* get_frame_limiter() throw() { return limiter_.get(); }
+	frame_pacer& get_frame_pacer() throw() { return frame_pacer_; }
 	interval& get_misc_interval() throw() { return misc_interval_; }
 	interval& get_status_interval() throw() { return status_interval_; }
+
+	// Fixed-timestep mode is enabled when the tick rate is non-zero.
+	bool is_fixed_step() const throw() { return tick_rate_ != 0; }
+	bool is_pipelined() const throw() { return pipelined_; }
+	bool is_bench() const throw() { return bench_frames_ != 0; }
+
+	// See %update_background().
+	bool is_background() const throw() { return background_; }
+	bool is_minimized() const throw() { return minimized_; }
+	bool is_recording() const throw() { return recorder_.get() != nullptr; }
+	bool is_replaying() const throw() { return player_.get() != nullptr; }
+	unsigned int get_seed() const throw() { return seed_; }
+	::Uint32 get_tick_rate() const throw() { return tick_rate_; }
+	double get_tick_sec() const throw()
+	{
+		return tick_rate_? 1.0 / tick_rate_: hr_timer_.delta_sec();
+	}
+	double get_alpha() const throw() { return alpha_; }
 	
+	// Handlers are run on the main thread by %poll_io() or, with
+	// general.io_thread, on a background thread.
 	boost::asio::io_service& get_io_service() throw() { return io_service_; }
 
+	// Available once the application has been constructed.
+	job::scheduler& get_job_system()
+	{
+		if (!job_system_)
+			PUP_ERR(std::logic_error, "job system not started");
+		return *job_system_;
+	}
+
+	const cfg::config& get_config() const throw() { return cfg_; }
+
+	// Incremented every time the config is (re)loaded.
+	unsigned int get_config_generation() const throw() { return config_generation_; }
+
+	// Key bindings of the current config by action name.
+	action_map& get_actions() throw() { return actions_; }
+
 	boost::property_tree::ptree& get_ptree() throw() { return pt_; }
 	boost::program_options::variables_map& get_opt_vm() throw() { return opt_vm_; }
 	
@@ -238,40 +702,128 @@ public:
 	virtual controller_ptr get_current_controller();
 
 	void queue_controller(controller_ptr ctrlr);
+	void queue_controller_async(controller_ptr ctrlr,
+		controller_ptr loading = controller_ptr());
+
+	// The oldest controller still loading asynchronously, if any.
+	controller_ptr get_pending_controller();
 	
 protected:
+	struct async_load
+	{
+		controller_ptr ctrlr;
+		std::shared_ptr<job::counter> done;
+		std::shared_ptr<std::exception_ptr> error;
+	};
+
+	typedef std::deque<async_load> async_load_queue;
+
+	void read_config();
+	void adopt_controllers();
+	bool update_timers();
+	void update_background();
+	void wait_background();
+
+	void apply_vsync();
+	void apply_frame_rate();
+	void apply_window();
+	void apply_resolution();
+	void apply_flight_recorder();
+	void apply_latency();
+	void apply_frame_latency();
+	void apply_config_watch();
+
+	void check_quit(event_span& events);
+	void track_input(const event_span& events);
+	void record_frame(const controller& ctrlr);
+
+	void start_io();
+	void stop_io() throw();
+	void start_metrics();
+	void stop_metrics() throw();
+
+	void write_bench();
+
 	::SDL_Window* window_;
 	::SDL_Surface* window_surface_;
 
 	::GLuint vertex_array_id_;
 	::SDL_GLContext gl_context_;
 
-	bool loop_;
+	std::atomic<bool> loop_;
 	bool first_config_;
+	bool pipelined_;
+	bool background_;
+	bool minimized_;
 
-	::Uint32 frame_delay_;
 	::Uint32 frame_count_;
 	::Uint32 frames_per_second_;
 	::Uint32 rendered_frames_;
-	::Uint32 event_tick_lim_;
+
+	::Uint32 tick_rate_;
+	::Uint32 tick_lim_;
+	::Sint64 tick_accumulator_;
+	double alpha_;
+
+	::Uint32 bench_frames_;
+	::Sint64 loop_start_;
+	::Sint64 startup_begin_;
+	unsigned int seed_;
+
+	std::unique_ptr<rec::recorder> recorder_;
+	std::unique_ptr<rec::player> player_;
+	rec::frame replay_frame_;
+	bool replay_fast_;
 
 	int gl_major_;
 	int gl_minor_;
 
 	boost::asio::io_service io_service_;
+	std::unique_ptr<boost::asio::io_service::work> io_work_;
+	std::thread io_thread_;
+	::Sint64 io_budget_;
+	bool io_threaded_;
+	boost::asio::io_service metrics_io_;
+	std::thread metrics_thread_;
+	std::unique_ptr<mtr::server> metrics_;
 
 	boost::property_tree::ptree pt_;
+	cfg::config cfg_;
+	action_map actions_;
+	unsigned int config_generation_;
+	bool config_preloaded_;
+	std::unique_ptr<cfg::watcher> config_watcher_;
+	std::unique_ptr<gl1::resolution_scaler> scaler_;
+	gl1::input_latency input_latency_;
+	std::unique_ptr<gl1::frame_limiter> limiter_;
 	boost::program_options::variables_map opt_vm_;
 	
 	snd::music* music_;
 	snd::jukebox* jukebox_;
 	snd::soundboard* soundboard_;
 
+	job::scheduler* job_system_;
+
 	timer timer_;
+	hr_timer hr_timer_;
+	frame_pacer frame_pacer_;
+	event_pump event_pump_;
+	prf::frame_profiler profiler_;
+	prf::flight_recorder flight_recorder_;
+	mem::alloc_stats alloc_frame_;
+	mem::alloc_stats alloc_loop_;
+	std::atomic<::Sint64> think_ns_;
+	prf::counter_values think_counters_; // only read once simulate() is done
 	interval misc_interval_;
 	interval status_interval_;
 	controller_queue controller_queue_;
 
+	std::thread::id main_thread_id_;
+	std::mutex pending_mutex_;
+	controller_queue pending_controllers_;
+	async_load_queue async_loads_;
+	simulation_thread simulation_thread_;
+
 	gl1::ft::typewriter typewriter_;
 };
 
@@ -311,7 +863,10 @@ public:
 	{
 		view_.clear();
 		view_.look();
+	}
 
+	virtual void render_overlay()
+	{
 		gl1::d2::scoped_screen_coordinate_matrix ssc_matrix;
 
 		form_.render();
@@ -335,6 +890,8 @@ template <class Application, typename CharT>
 int run(int argc, CharT* argv[], boost::program_options::options_description& opt_desc,
 	::Uint32 sdl_flags = PUP_SDL_DEFAULT_INIT)
 {
+	log::scoped_backend logging;
+
 	try {
 		boost::program_options::variables_map opt_vm;
 		boost::program_options::store(
@@ -350,7 +907,7 @@ int run(int argc, CharT* argv[], boost::program_options::options_description& op
 		Application(sdl_flags, opt_vm).loop();
 	}
 	catch (const std::exception& e) {
-		BOOST_LOG_TRIVIAL(fatal) << boost::format("[%1%] %2%")
+		PUP_LOG(fatal) << boost::format("[%1%] %2%")
 			% errno % e.what();
 		return EXIT_FAILURE;
 	}
@@ -0,0 +1,244 @@
+
+// libPowerUP - Create games with SDL2 and OpenGL
+// Copyright(c) 2015, Erik Edlund <erik.edlund@32767.se>
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with
+// or without modification, are permitted provided that the
+// following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above
+//    copyright notice, this list of conditions and the
+//    following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above
+//    copyright notice, this list of conditions and the
+//    following disclaimer in the documentation and / or
+//    other materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names
+//    of its contributors may be used to endorse or promote
+//    products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES(INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+
+#include "pup_cfg.h"
+#include "pup_log.h"
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace pup {
+namespace cfg {
+
+namespace {
+
+template <typename T>
+void require(bool valid, const char* key, const T& value, const char* expected)
+{
+	if (!valid) {
+		PUP_ERR(std::runtime_error, boost::str(boost::format(
+			"invalid config value %1%=%2%, expected %3%") % key % value % expected));
+	}
+}
+
+} // anonymous
+
+config::config() :
+	random_seed(0),
+	tick_rate(0),
+	tick_lim(5),
+	pipelined(false),
+	io_budget_us(1000),
+	io_thread(false),
+	event_batch(256),
+	profile_frames(1024),
+	profile_counters(false),
+	job_workers(0),
+	config_watch(true),
+	background_rate(0.0),
+	spike_budget_us(0),
+	spike_frames(300),
+	spike_cooldown(10.0),
+	spike_dir("."),
+	metrics_interval_ms(250),
+	vsync(0),
+	frame_rate(0.0),
+	frame_spin_us(1000),
+	window_width(640),
+	window_height(480),
+	window_fullscreen(false),
+	fov(45.0f),
+	z_near(0.1f),
+	z_far(100.0f),
+	dynamic_resolution(false),
+	resolution_min(0.5),
+	resolution_max(1.0),
+	resolution_budget_us(0),
+	latency_fence(false),
+	frame_latency(0),
+	late_input(false),
+	music_volume(MIX_MAX_VOLUME)
+{
+}
+
+void config::load(const boost::property_tree::ptree& pt)
+{
+	// Keys that are not set keep the defaults of a new config.
+	*this = config();
+
+	random_seed = pt.get<unsigned int>("general.random_seed");
+	tick_rate = pt.get<::Uint32>("general.tick_rate", tick_rate);
+	tick_lim = std::max<::Uint32>(pt.get<::Uint32>("general.tick_lim", tick_lim), 1);
+	pipelined = pt.get<bool>("general.pipelined", pipelined);
+	io_budget_us = pt.get<::Sint64>("general.io_budget_us", io_budget_us);
+	io_thread = pt.get<bool>("general.io_thread", io_thread);
+	event_batch = pt.get<size_type>("general.event_batch", event_batch);
+	profile_frames = pt.get<size_type>("general.profile_frames", profile_frames);
+	profile_counters = pt.get<bool>("general.profile_counters", profile_counters);
+	job_workers = pt.get<size_type>("general.job_workers", job_workers);
+	config_watch = pt.get<bool>("general.config_watch", config_watch);
+	background_rate = pt.get<double>("general.background_rate", background_rate);
+	spike_budget_us = pt.get<::Sint64>("general.spike_budget_us", spike_budget_us);
+	spike_frames = pt.get<size_type>("general.spike_frames", spike_frames);
+	spike_cooldown = pt.get<double>("general.spike_cooldown", spike_cooldown);
+	spike_dir = pt.get<std::string>("general.spike_dir", spike_dir);
+	metrics = pt.get<std::string>("general.metrics", metrics);
+	metrics_interval_ms = pt.get<::Sint64>("general.metrics_interval_ms", metrics_interval_ms);
+
+	vsync = pt.get<unsigned int>("graphics.vsync");
+	frame_rate = pt.get<double>("graphics.frame_rate", frame_rate);
+	frame_spin_us = pt.get<::Sint64>("graphics.frame_spin_us", frame_spin_us);
+	window_width = pt.get<int>("graphics.window_width");
+	window_height = pt.get<int>("graphics.window_height");
+	window_fullscreen = pt.get<bool>("graphics.window_fullscreen");
+	fov = pt.get<float>("graphics.fov");
+	z_near = pt.get<float>("graphics.z_near");
+	z_far = pt.get<float>("graphics.z_far");
+	dynamic_resolution = pt.get<bool>("graphics.dynamic_resolution", dynamic_resolution);
+	resolution_min = pt.get<double>("graphics.resolution_min", resolution_min);
+	resolution_max = pt.get<double>("graphics.resolution_max", resolution_max);
+	resolution_budget_us = pt.get<::Sint64>("graphics.resolution_budget_us", resolution_budget_us);
+	latency_fence = pt.get<bool>("graphics.latency_fence", latency_fence);
+	frame_latency = pt.get<unsigned int>("graphics.frame_latency", frame_latency);
+	late_input = pt.get<bool>("graphics.late_input", late_input);
+
+	music_volume = pt.get<int>("sound.music_volume");
+
+	require(io_budget_us >= 0, "general.io_budget_us", io_budget_us, ">= 0");
+	require(event_batch > 0, "general.event_batch", event_batch, "> 0");
+	require(background_rate >= 0.0, "general.background_rate", background_rate, ">= 0");
+	require(spike_budget_us >= 0, "general.spike_budget_us", spike_budget_us, ">= 0");
+	require(spike_frames > 0, "general.spike_frames", spike_frames, "> 0");
+	require(spike_cooldown >= 0.0, "general.spike_cooldown", spike_cooldown, ">= 0");
+	require(metrics.empty() || boost::starts_with(metrics, "tcp:") || boost::starts_with(metrics, "unix:"),
+		"general.metrics", metrics, "tcp:<port> or unix:<path>");
+	require(metrics_interval_ms > 0, "general.metrics_interval_ms", metrics_interval_ms, "> 0");
+	require(frame_rate >= 0.0, "graphics.frame_rate", frame_rate, ">= 0");
+	require(frame_spin_us >= 0, "graphics.frame_spin_us", frame_spin_us, ">= 0");
+	require(window_width > 0, "graphics.window_width", window_width, "> 0");
+	require(window_height > 0, "graphics.window_height", window_height, "> 0");
+	require(fov > 0.0f && fov < 180.0f, "graphics.fov", fov, "in (0, 180)");
+	require(z_near > 0.0f, "graphics.z_near", z_near, "> 0");
+	require(z_far > z_near, "graphics.z_far", z_far, "> graphics.z_near");
+	require(resolution_min > 0.0 && resolution_min <= resolution_max,
+		"graphics.resolution_min", resolution_min, "in (0, graphics.resolution_max]");
+	require(resolution_max <= 2.0, "graphics.resolution_max", resolution_max, "<= 2");
+	require(resolution_budget_us >= 0, "graphics.resolution_budget_us", resolution_budget_us, ">= 0");
+	require(frame_latency <= 3, "graphics.frame_latency", frame_latency, "0 to 3");
+	require(music_volume >= 0 && music_volume <= MIX_MAX_VOLUME,
+		"sound.music_volume", music_volume, "in [0, 128]");
+
+	values.clear();
+	BOOST_FOREACH(const boost::property_tree::ptree::value_type& section, pt) {
+		BOOST_FOREACH(const boost::property_tree::ptree::value_type& key, section.second) {
+			values[section.first + "." + key.first] = key.second.data();
+		}
+	}
+}
+
+#ifdef __linux__
+
+watcher::watcher(const boost::filesystem::path& path) :
+	fd_(::inotify_init1(IN_NONBLOCK | IN_CLOEXEC)),
+	name_(path.filename().string()),
+	buffer_(4096)
+{
+	if (fd_ < 0) {
+		PUP_LOG(warning) << boost::format("failed to watch \"%1%\": %2%")
+			% path.string() % std::strerror(errno);
+		return;
+	}
+
+	const boost::filesystem::path dir(path.has_parent_path()?
+		path.parent_path(): boost::filesystem::path("."));
+	if (::inotify_add_watch(fd_, dir.string().c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+		PUP_LOG(warning) << boost::format("failed to watch \"%1%\": %2%")
+			% path.string() % std::strerror(errno);
+		::close(fd_);
+		fd_ = -1;
+	}
+}
+
+watcher::~watcher() throw()
+{
+	if (fd_ >= 0)
+		::close(fd_);
+}
+
+bool watcher::changed()
+{
+	bool changed = false;
+	ssize_t n;
+
+	if (fd_ < 0)
+		return false;
+
+	while ((n = ::read(fd_, &buffer_[0], buffer_.size())) > 0) {
+		for (ssize_t i = 0; i < n; ) {
+			const ::inotify_event* event = reinterpret_cast<const ::inotify_event*>(&buffer_[i]);
+			if (event->len && name_ == event->name)
+				changed = true;
+			i += sizeof(::inotify_event) + event->len;
+		}
+	}
+	return changed;
+}
+
+#else
+
+watcher::watcher(const boost::filesystem::path& path) :
+	fd_(-1)
+{
+	(void)path;
+}
+
+watcher::~watcher() throw()
+{
+}
+
+bool watcher::changed()
+{
+	return false;
+}
+
+#endif
+
+} // cfg
+} // pup
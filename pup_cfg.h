@@ -0,0 +1,129 @@
+
+// libPowerUP - Create games with SDL2 and OpenGL
+// Copyright(c) 2015, Erik Edlund <erik.edlund@32767.se>
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with
+// or without modification, are permitted provided that the
+// following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above
+//    copyright notice, this list of conditions and the
+//    following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above
+//    copyright notice, this list of conditions and the
+//    following disclaimer in the documentation and / or
+//    other materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names
+//    of its contributors may be used to endorse or promote
+//    products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES(INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+
+#ifndef LIBPUP_PUP_CFG_H
+#define LIBPUP_PUP_CFG_H
+
+#include "pup_env.h"
+#include "pup_core.h"
+
+namespace pup {
+namespace cfg {
+
+// The settings of the application, parsed and validated once
+// per (re)load instead of looked up by name where they are used.
+// Keys without a default must be present in the config file.
+struct config
+{
+	typedef std::map<std::string, std::string> value_map;
+
+	config();
+
+	void load(const boost::property_tree::ptree& pt);
+
+	// general
+	unsigned int random_seed;
+	::Uint32 tick_rate;
+	::Uint32 tick_lim;
+	bool pipelined;
+	::Sint64 io_budget_us;
+	bool io_thread;
+	size_type event_batch;
+	size_type profile_frames;
+	bool profile_counters;
+	size_type job_workers;
+	bool config_watch;
+	double background_rate;
+	::Sint64 spike_budget_us;
+	size_type spike_frames;
+	double spike_cooldown;
+	std::string spike_dir;
+	std::string metrics;
+	::Sint64 metrics_interval_ms;
+
+	// graphics
+	unsigned int vsync;
+	double frame_rate;
+	::Sint64 frame_spin_us;
+	int window_width;
+	int window_height;
+	bool window_fullscreen;
+	float fov;
+	float z_near;
+	float z_far;
+	bool dynamic_resolution;
+	double resolution_min;
+	double resolution_max;
+	::Sint64 resolution_budget_us;
+	bool latency_fence;
+	unsigned int frame_latency;
+	bool late_input;
+
+	// sound
+	int music_volume;
+
+	// Every key of the file, including those above.
+	value_map values;
+};
+
+// Reports changes to a file by watching its directory, so that
+// files replaced by a rename are noticed too. Only implemented
+// on Linux (inotify), elsewhere no change is ever reported.
+class watcher :
+	private boost::noncopyable
+{
+public:
+	explicit watcher(const boost::filesystem::path& path);
+	~watcher() throw();
+
+	// Never blocks. True if the file has been written or replaced
+	// since the last call.
+	bool changed();
+
+	bool enabled() const throw() { return fd_ >= 0; }
+
+private:
+	int fd_;
+	std::string name_;
+	std::vector<char> buffer_;
+};
+
+} // cfg
+} // pup
+
+#endif
@@ -212,6 +212,399 @@ void pyramid::do_render()
 
 } // d3
 
+gpu_timer::gpu_timer(size_type depth) :
+	queries_(std::max<size_type>(depth, 2), 0),
+	pending_(queries_.size(), false),
+	head_(0),
+	last_(0),
+	results_(0),
+	active_(false)
+{
+	if (gpu_timer::supported())
+		::glGenQueries(static_cast<::GLsizei>(queries_.size()), &queries_[0]);
+}
+
+gpu_timer::~gpu_timer() throw()
+{
+	if (queries_[0])
+		::glDeleteQueries(static_cast<::GLsizei>(queries_.size()), &queries_[0]);
+}
+
+bool gpu_timer::supported() throw()
+{
+	return GLEW_ARB_timer_query != 0;
+}
+
+void gpu_timer::begin()
+{
+	if (!queries_[0])
+		return;
+
+	this->poll();
+	if (pending_[head_])
+		return;
+
+	::glBeginQuery(GL_TIME_ELAPSED, queries_[head_]);
+	active_ = true;
+}
+
+void gpu_timer::end()
+{
+	if (!active_)
+		return;
+
+	::glEndQuery(GL_TIME_ELAPSED);
+	pending_[head_] = true;
+	head_ = (head_ + 1) % queries_.size();
+	active_ = false;
+}
+
+// Collect available results, oldest first.
+void gpu_timer::poll()
+{
+	for (size_type i = 0; i < queries_.size(); ++i) {
+		const size_type q = (head_ + i) % queries_.size();
+		if (!pending_[q])
+			continue;
+
+		::GLint available = 0;
+		::glGetQueryObjectiv(queries_[q], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+			break;
+
+		::GLuint64 ns = 0;
+		::glGetQueryObjectui64v(queries_[q], GL_QUERY_RESULT, &ns);
+		last_ = static_cast<::Sint64>(ns);
+		pending_[q] = false;
+		results_++;
+	}
+}
+
+resolution_scaler::resolution_scaler(double min_scale, double max_scale, ::Sint64 budget) :
+	fbo_(0),
+	color_(0),
+	depth_(0),
+	window_w_(0),
+	window_h_(0),
+	width_(0),
+	height_(0),
+	min_(1.0),
+	max_(1.0),
+	scale_(1.0),
+	budget_(budget),
+	average_(0.0),
+	results_(0)
+{
+	this->set_limits(min_scale, max_scale);
+	scale_ = max_;
+
+	::glGenFramebuffers(1, &fbo_);
+	::glGenRenderbuffers(1, &color_);
+	::glGenRenderbuffers(1, &depth_);
+}
+
+resolution_scaler::~resolution_scaler() throw()
+{
+	::glDeleteRenderbuffers(1, &depth_);
+	::glDeleteRenderbuffers(1, &color_);
+	::glDeleteFramebuffers(1, &fbo_);
+}
+
+bool resolution_scaler::supported() throw()
+{
+	return GLEW_VERSION_3_0 || GLEW_ARB_framebuffer_object;
+}
+
+void resolution_scaler::resize(int window_w, int window_h)
+{
+	window_w_ = std::max(window_w, 1);
+	window_h_ = std::max(window_h, 1);
+
+	const ::GLsizei w = static_cast<::GLsizei>(std::ceil(window_w_ * max_));
+	const ::GLsizei h = static_cast<::GLsizei>(std::ceil(window_h_ * max_));
+
+	::glBindRenderbuffer(GL_RENDERBUFFER, color_);
+	::glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, w, h);
+	::glBindRenderbuffer(GL_RENDERBUFFER, depth_);
+	::glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, w, h);
+	::glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	::glBindFramebuffer(GL_FRAMEBUFFER, fbo_);
+	::glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color_);
+	::glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth_);
+	const ::GLenum status = ::glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	::glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	if (status != GL_FRAMEBUFFER_COMPLETE) {
+		PUP_ERR(std::runtime_error, boost::str(boost::format(
+			"incomplete framebuffer (status=0x%1$x)") % status));
+	}
+
+	this->update_size();
+}
+
+void resolution_scaler::begin()
+{
+	::glBindFramebuffer(GL_FRAMEBUFFER, fbo_);
+	::glViewport(0, 0, width_, height_);
+	::glScissor(0, 0, width_, height_);
+	::glEnable(GL_SCISSOR_TEST);
+
+	timer_.begin();
+}
+
+void resolution_scaler::end()
+{
+	timer_.end();
+
+	::glDisable(GL_SCISSOR_TEST);
+	::glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo_);
+	::glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+	::glBlitFramebuffer(
+		0, 0, width_, height_,
+		0, 0, window_w_, window_h_,
+		GL_COLOR_BUFFER_BIT,
+		GL_LINEAR
+	);
+	::glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	::glViewport(0, 0, window_w_, window_h_);
+
+	this->adapt();
+}
+
+void resolution_scaler::set_limits(double min_scale, double max_scale)
+{
+	if (min_scale <= 0.0 || min_scale > max_scale)
+		PUP_ERR(std::invalid_argument, "invalid resolution scale limits");
+
+	const bool realloc = max_scale != max_ && window_w_;
+
+	min_ = min_scale;
+	max_ = max_scale;
+	scale_ = std::min(std::max(scale_, min_), max_);
+
+	if (realloc)
+		this->resize(window_w_, window_h_);
+	else
+		this->update_size();
+}
+
+// Aim a bit below the budget and leave some slack before the
+// scale is changed again. The GPU time is taken to be roughly
+// proportional to the number of pixels rendered, and the scale
+// changes by at most 10% at a time.
+void resolution_scaler::adapt()
+{
+	if (timer_.get_results() == results_)
+		return;
+
+	results_ = timer_.get_results();
+
+	const double t = static_cast<double>(timer_.get_last());
+	average_ = average_ > 0.0? average_ + (t - average_) * 0.1: t;
+
+	if (average_ <= 0.0 || (average_ > budget_ * 0.8 && average_ < budget_ * 0.95))
+		return;
+
+	double scale = scale_ * std::sqrt(budget_ * 0.9 / average_);
+	scale = std::min(std::max(scale, scale_ * 0.9), scale_ * 1.1);
+	scale = std::min(std::max(scale, min_), max_);
+
+	if (std::abs(scale - scale_) < 0.01)
+		return;
+
+	average_ *= (scale * scale) / (scale_ * scale_);
+	scale_ = scale;
+	this->update_size();
+}
+
+void resolution_scaler::update_size() throw()
+{
+	width_ = std::max(static_cast<int>(window_w_ * scale_ + 0.5), 1);
+	height_ = std::max(static_cast<int>(window_h_ * scale_ + 0.5), 1);
+}
+
+// The inputs of a frame are kept in preallocated storage.
+static const size_type input_latency_capacity = 256;
+
+input_latency::input_latency(size_type window, size_type depth) :
+	frames_(std::max<size_type>(depth, 1)),
+	head_(0),
+	count_(0),
+	frame_inputs_(0),
+	frame_max_(0),
+	fence_(false),
+	swap_(window),
+	gpu_(window)
+{
+	pending_.reserve(input_latency_capacity);
+	for (auto it = frames_.begin(); it != frames_.end(); ++it) {
+		it->fence = nullptr;
+		it->inputs.reserve(input_latency_capacity);
+	}
+}
+
+input_latency::~input_latency() throw()
+{
+	this->clear_fences();
+}
+
+bool input_latency::fence_supported() throw()
+{
+	return GLEW_ARB_sync != 0;
+}
+
+void input_latency::set_fence(bool enabled)
+{
+	if (!enabled)
+		this->clear_fences();
+	fence_ = enabled && input_latency::fence_supported();
+}
+
+void input_latency::input(::Sint64 at) throw()
+{
+	if (pending_.size() < input_latency_capacity)
+		pending_.push_back(at);
+}
+
+void input_latency::swapped(::Sint64 at)
+{
+	frame_inputs_ = pending_.size();
+	frame_max_ = 0;
+
+	for (auto it = pending_.begin(); it != pending_.end(); ++it) {
+		const ::Sint64 ns = std::max<::Sint64>(at - *it, 0);
+		swap_.add(ns);
+		frame_max_ = std::max(frame_max_, ns);
+	}
+
+	if (fence_ && !pending_.empty()) {
+		this->poll();
+		if (count_ < frames_.size()) {
+			frame& f = frames_[(head_ + count_) % frames_.size()];
+			f.fence = ::glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			if (f.fence) {
+				f.inputs.assign(pending_.begin(), pending_.end());
+				count_++;
+			}
+		}
+	}
+	pending_.clear();
+}
+
+void input_latency::discard() throw()
+{
+	pending_.clear();
+	frame_inputs_ = 0;
+	frame_max_ = 0;
+}
+
+// Retire signalled fences, oldest first.
+void input_latency::poll()
+{
+	while (count_) {
+		frame& f = frames_[head_];
+
+		const ::GLenum status = ::glClientWaitSync(f.fence, 0, 0);
+		if (status == GL_TIMEOUT_EXPIRED)
+			break;
+
+		if (status != GL_WAIT_FAILED) {
+			const ::Sint64 now = prf::now();
+			for (auto it = f.inputs.begin(); it != f.inputs.end(); ++it)
+				gpu_.add(std::max<::Sint64>(now - *it, 0));
+		}
+
+		::glDeleteSync(f.fence);
+		f.fence = nullptr;
+		head_ = (head_ + 1) % frames_.size();
+		count_--;
+	}
+}
+
+void input_latency::set_window(size_type window)
+{
+	swap_.set_window(window);
+	gpu_.set_window(window);
+}
+
+void input_latency::clear_fences() throw()
+{
+	for (; count_; count_--) {
+		::glDeleteSync(frames_[head_].fence);
+		frames_[head_].fence = nullptr;
+		head_ = (head_ + 1) % frames_.size();
+	}
+}
+
+frame_limiter::frame_limiter(size_type depth, ::Sint64 timeout) :
+	head_(0),
+	count_(0),
+	depth_(1),
+	timeout_(timeout),
+	last_wait_(0),
+	timeouts_(0)
+{
+	fences_.fill(nullptr);
+	this->set_depth(depth);
+}
+
+frame_limiter::~frame_limiter() throw()
+{
+	for (; count_; count_--) {
+		::glDeleteSync(fences_[head_]);
+		fences_[head_] = nullptr;
+		head_ = (head_ + 1) % fences_.size();
+	}
+}
+
+bool frame_limiter::supported() throw()
+{
+	return GLEW_ARB_sync != 0;
+}
+
+void frame_limiter::swapped()
+{
+	// Only when %wait() was skipped, e.g. by a custom loop.
+	if (count_ == fences_.size())
+		this->wait_oldest();
+
+	::GLsync fence = ::glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	if (!fence)
+		return;
+
+	fences_[(head_ + count_) % fences_.size()] = fence;
+	count_++;
+}
+
+void frame_limiter::wait()
+{
+	const ::Sint64 begin = prf::now();
+	while (count_ && count_ >= depth_)
+		this->wait_oldest();
+	last_wait_ = prf::now() - begin;
+}
+
+void frame_limiter::set_depth(size_type depth) throw()
+{
+	depth_ = std::max<size_type>(std::min(depth, fences_.size()), 1);
+}
+
+// The flush makes sure the fence is submitted, waiting on a fence
+// that is never submitted would always time out.
+void frame_limiter::wait_oldest() throw()
+{
+	const ::GLenum status = ::glClientWaitSync(fences_[head_], GL_SYNC_FLUSH_COMMANDS_BIT,
+		static_cast<::GLuint64>(timeout_));
+	if (status == GL_TIMEOUT_EXPIRED || status == GL_WAIT_FAILED)
+		timeouts_++;
+
+	::glDeleteSync(fences_[head_]);
+	fences_[head_] = nullptr;
+	head_ = (head_ + 1) % fences_.size();
+	count_--;
+}
+
 namespace ft {
 
 face::face(
@@ -232,8 +625,11 @@ face::face(
 {
 	::FT_Face f;
 	
-	if (::FT_New_Face(tw.get_lib(), path.string().c_str(), 0, &f) != 0)
-		PUP_ERR(std::runtime_error, "failed to load font face");
+	{
+		std::lock_guard<std::mutex> lock(tw.get_lib_mutex());
+		if (::FT_New_Face(tw.get_lib(), path.string().c_str(), 0, &f) != 0)
+			PUP_ERR(std::runtime_error, "failed to load font face");
+	}
 
 	::FT_Set_Char_Size(f, size << 6, size << 6, 96, 96);
 	::glGenTextures(128, textures_);
@@ -241,6 +637,61 @@ face::face(
 	for (unsigned char ch = first_char_; ch <= last_char_; ++ch)
 		this->load_char(f, ch);
 	
+	std::lock_guard<std::mutex> lock(tw.get_lib_mutex());
+	::FT_Done_Face(f);
+}
+
+face::face(
+	const glyph_vector& glyphs,
+	int size,
+	const rgb& c,
+	::GLfloat d
+) :
+	first_char_(32),
+	last_char_(127),
+	color_(c),
+	textures_(new ::GLuint[128]),
+	lists_(::glGenLists(128)),
+	size_(static_cast<::GLfloat>(size)),
+	divisor_(d),
+	dims_(new d2::size[128])
+{
+	if (glyphs.size() <= last_char_)
+		PUP_ERR(std::invalid_argument, "missing glyphs");
+
+	::glGenTextures(128, textures_);
+
+	for (unsigned char ch = first_char_; ch <= last_char_; ++ch)
+		this->upload_char(ch, glyphs[ch]);
+}
+
+void face::rasterize(typewriter& tw, const boost::filesystem::path& path,
+	int size, glyph_vector& glyphs)
+{
+	PUP_ZONE("ft::face::rasterize");
+
+	::FT_Face f;
+
+	{
+		std::lock_guard<std::mutex> lock(tw.get_lib_mutex());
+		if (::FT_New_Face(tw.get_lib(), path.string().c_str(), 0, &f) != 0)
+			PUP_ERR(std::runtime_error, "failed to load font face");
+	}
+
+	glyphs.assign(128, glyph());
+
+	try {
+		::FT_Set_Char_Size(f, size << 6, size << 6, 96, 96);
+		for (unsigned char ch = 32; ch <= 127; ++ch)
+			face::rasterize_char(f, ch, glyphs[ch]);
+	}
+	catch (...) {
+		std::lock_guard<std::mutex> lock(tw.get_lib_mutex());
+		::FT_Done_Face(f);
+		throw;
+	}
+
+	std::lock_guard<std::mutex> lock(tw.get_lib_mutex());
 	::FT_Done_Face(f);
 }
 
@@ -255,12 +706,15 @@ face::~face() throw()
 
 void face::print_2d(int x, int y, const std::string& text, const rgb& col)
 {
-	//::GLuint font = lists_;
-	::GLfloat size = this->line_height();
+	this->print_2d(x, y, text.data(), text.size(), col);
+}
 
-	string_vector lines;
+void face::print_2d(int x, int y, const char* text, size_type n, const rgb& col)
+{
+	PUP_ZONE("ft::face::print_2d");
 
-	boost::split(lines, text, boost::is_any_of("\n"));
+	//::GLuint font = lists_;
+	::GLfloat size = this->line_height();
 
 	::glPushAttrib(GL_LIST_BIT
 		| GL_CURRENT_BIT
@@ -282,8 +736,13 @@ void face::print_2d(int x, int y, const std::string& text, const rgb& col)
 
 	::glColor3f(col.r, col.g, col.b);
 
-	for (auto it = lines.begin(); it != lines.end(); ++it) {
-		int i = it - lines.begin();
+	// Lines are printed straight from the text, without splitting
+	// it into strings.
+	const char* end = text + n;
+	int i = 0;
+
+	for (const char* line = text; line <= end; ++i) {
+		const char* eol = std::find(line, end, '\n');
 
 		::glPushMatrix();
 
@@ -295,9 +754,11 @@ void face::print_2d(int x, int y, const std::string& text, const rgb& col)
 		);
 		::glMultMatrixf(modelview_matrix);
 
-		::glCallLists(it->length(), GL_UNSIGNED_BYTE, it->c_str());
+		::glCallLists(static_cast<::GLsizei>(eol - line), GL_UNSIGNED_BYTE, line);
 		
 		::glPopMatrix();
+
+		line = eol + 1;
 	}
 
 	::glPopAttrib();
@@ -309,12 +770,19 @@ void face::print_2d(int x, int y, const std::string& text)
 }
 
 ::GLuint face::text_width(const std::string& text)
+{
+	return this->text_width(text.data(), text.size());
+}
+
+::GLuint face::text_width(const char* text, size_type n)
 {
 	::GLuint width = 0;
-	::GLuint length = text.length();
 	
-	for (::GLuint i = 0; i < length; ++i)
-		width += dims_[text[i]].w();
+	for (size_type i = 0; i < n; ++i) {
+		const unsigned char ch = static_cast<unsigned char>(text[i]);
+		if (ch <= last_char_)
+			width += dims_[ch].w();
+	}
 	return width;
 }
 
@@ -330,6 +798,13 @@ void face::print_2d(int x, int y, const std::string& text)
 }
 
 void face::load_char(::FT_Face f, unsigned char ch)
+{
+	glyph g;
+	face::rasterize_char(f, ch, g);
+	this->upload_char(ch, g);
+}
+
+void face::rasterize_char(::FT_Face f, unsigned char ch, glyph& g)
 {
 	if (::FT_Load_Glyph(f, ::FT_Get_Char_Index(f, ch), FT_LOAD_DEFAULT) != 0)
 		PUP_ERR(std::runtime_error, boost::str(boost::format("failed to load character '%1%'") % ch));
@@ -361,58 +836,68 @@ typedef std::size_t load_char_size_type;
 	load_char_size_type width = next_ilog2(bitmap.width);
 	load_char_size_type height = next_ilog2(bitmap.rows);
 
-	::GLubyte* expanded_data = new ::GLubyte[2 * width * height];
+	g.data.resize(2 * width * height);
 
 	for (load_char_size_type j = 0; j < height; ++j) {
 		for (load_char_size_type i = 0; i < width; ++i) {
-			expanded_data[2 * (i + j * width)]
-				= expanded_data[2 * (i + j * width) + 1]
+			g.data[2 * (i + j * width)]
+				= g.data[2 * (i + j * width) + 1]
 				= (i >= bitmap.width || j >= bitmap.rows)?
 					0 : bitmap.buffer[i + bitmap.width * j];
 		}
 	}
 
+	g.width = static_cast<int>(width);
+	g.height = static_cast<int>(height);
+	g.bitmap_width = static_cast<int>(bitmap.width);
+	g.bitmap_rows = static_cast<int>(bitmap.rows);
+	g.left = bitmap_glyph->left;
+	g.top = bitmap_glyph->top;
+	g.advance = f->glyph->advance.x >> 6;
+	g.metrics_height = f->glyph->metrics.height >> 6;
+
+	::FT_Done_Glyph(glyph);
+}
+
+void face::upload_char(unsigned char ch, const glyph& g)
+{
 	::glBindTexture(GL_TEXTURE_2D, textures_[ch]);
 	::glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	::glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 
-	::glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height,
-		0, GL_LUMINANCE_ALPHA, GL_UNSIGNED_BYTE, expanded_data);
-
-	delete[] expanded_data;
+	::glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, g.width, g.height,
+		0, GL_LUMINANCE_ALPHA, GL_UNSIGNED_BYTE, g.data.empty()? nullptr: &g.data[0]);
 
 	::glNewList(lists_ + ch, GL_COMPILE);
 	::glBindTexture(GL_TEXTURE_2D, textures_[ch]);
 	
 	::glPushMatrix();
-		::glTranslatef(static_cast<::GLfloat>(bitmap_glyph->left), 0, 0);
-		::glTranslatef(0, static_cast<::GLfloat>(
-			static_cast<int>(bitmap_glyph->top) - static_cast<int>(bitmap.rows)
-		), 0);
+		::glTranslatef(static_cast<::GLfloat>(g.left), 0, 0);
+		::glTranslatef(0, static_cast<::GLfloat>(g.top - g.bitmap_rows), 0);
 
-		::GLfloat x = static_cast<::GLfloat>(bitmap.width) / static_cast<::GLfloat>(width);
-		::GLfloat y = static_cast<::GLfloat>(bitmap.rows) / static_cast<::GLfloat>(height);
+		::GLfloat x = static_cast<::GLfloat>(g.bitmap_width) / static_cast<::GLfloat>(g.width);
+		::GLfloat y = static_cast<::GLfloat>(g.bitmap_rows) / static_cast<::GLfloat>(g.height);
 
 		::glBegin(GL_QUADS);
 			::glTexCoord2d(0, 0);
-			::glVertex2f(0, static_cast<::GLfloat>(bitmap.rows));
+			::glVertex2f(0, static_cast<::GLfloat>(g.bitmap_rows));
 
 			::glTexCoord2d(0, y);
 			::glVertex2f(0, 0);
 
 			::glTexCoord2d(x, y);
-			::glVertex2f(static_cast<::GLfloat>(bitmap.width), 0);
+			::glVertex2f(static_cast<::GLfloat>(g.bitmap_width), 0);
 
 			::glTexCoord2d(x, 0);
-			::glVertex2f(static_cast<::GLfloat>(bitmap.width), static_cast<::GLfloat>(bitmap.rows));
+			::glVertex2f(static_cast<::GLfloat>(g.bitmap_width), static_cast<::GLfloat>(g.bitmap_rows));
 		::glEnd();
 	::glPopMatrix();
 
-	::glTranslatef(static_cast<::GLfloat>(f->glyph->advance.x >> 6), 0, 0);
+	::glTranslatef(static_cast<::GLfloat>(g.advance), 0, 0);
 
 	dims_[ch].wh(
-		f->glyph->advance.x >> 6,
-		f->glyph->metrics.height >> 6
+		g.advance,
+		g.metrics_height
 	);
 
 	::glEndList();
@@ -433,9 +918,40 @@ typewriter::~typewriter() throw()
 
 void typewriter::load(const boost::filesystem::path& path,
 	int size, const rgb& c, ::GLfloat d)
+{
+	this->insert(path, size, face_ptr(new face(*this, path, size, c, d)));
+}
+
+void typewriter::load(const font_vector& fonts, job::scheduler& js)
+{
+	PUP_ZONE("ft::typewriter::load");
+
+	std::vector<glyph_vector> glyphs(fonts.size());
+	std::vector<std::exception_ptr> errors(fonts.size());
+
+	js.parallel_for(0, fonts.size(), 1, [&](size_type first, size_type last) {
+		for (size_type i = first; i < last; ++i) {
+			try {
+				face::rasterize(*this, fonts[i].path, fonts[i].size, glyphs[i]);
+			}
+			catch (...) {
+				errors[i] = std::current_exception();
+			}
+		}
+	});
+
+	for (size_type i = 0; i < fonts.size(); ++i) {
+		if (errors[i])
+			std::rethrow_exception(errors[i]);
+		this->insert(fonts[i].path, fonts[i].size, face_ptr(new face(glyphs[i],
+			fonts[i].size, fonts[i].color, fonts[i].divisor)));
+	}
+}
+
+void typewriter::insert(const boost::filesystem::path& path, int size, face_ptr f)
 {
 	faces_.insert(face_map::value_type(boost::filesystem::basename(path)
-		.append(std::to_string(size)), face_ptr(new face(*this, path, size, c, d))));
+		.append(std::to_string(size)), f));
 }
 
 face_ptr& typewriter::find_ptr(std::string name, int size)
@@ -460,25 +976,28 @@ void print_2d(const std::string& text, const rgb& col, face_ptr& face,
 	int x;
 	int y = origo_y;
 	
-	string_vector lines;
-	boost::split(lines, text, boost::is_any_of("\n"));
+	const char* end = text.data() + text.size();
+
+	for (const char* line = text.data(); line <= end; ) {
+		const char* eol = std::find(line, end, '\n');
+		const size_type n = eol - line;
 
-	for (auto line = lines.begin(); line != lines.end(); ++line) {
 		switch (align) {
 		case ft::ALIGN_LEFT:
 			x = origo_x;
 			break;
 		case ft::ALIGN_RIGHT:
-			x = origo_x + w - face->text_width(*line);
+			x = origo_x + w - face->text_width(line, n);
 			break;
 		case ft::ALIGN_CENTER:
-			x = origo_x + w / 2 - face->text_width(*line) / 2;
+			x = origo_x + w / 2 - face->text_width(line, n) / 2;
 			break;
 		}
 
-		face->print_2d(x, y, *line, col);
+		face->print_2d(x, y, line, n, col);
 
 		y -= static_cast<int>(face->line_height());
+		line = eol + 1;
 	}
 }
 
@@ -616,6 +1135,8 @@ void collection::render()
 
 void collection::finalize()
 {
+	PUP_ZONE("ui::collection::finalize");
+
 	expander::finalize();
 
 	d2::point r(0, 0);
@@ -711,8 +1232,12 @@ int widget::get_width()
 
 bool widget::validate()
 {
+	if (validators_.empty())
+		return true;
+
+	const std::string value(this->string_value());
 	for (auto it = validators_.begin(); it != validators_.end(); ++it) {
-		if (!it->second(this->string_value()))
+		if (!it->second(value))
 			return false;
 	}
 	return true;
@@ -936,12 +1461,14 @@ void input::render()
 		this->get_owner().get_theme().get("value")
 	);
 
-	std::string value_fix(value_ + append_);
+	mem::frame_string value_fix(value_.begin(), value_.end());
+	value_fix += append_;
 	
 	this->get_owner().get_theme().get_value_face()->print_2d(
 		value_pos_.x(),
 		value_pos_.y(),
-		value_fix,
+		value_fix.data(),
+		value_fix.size(),
 		this->get_owner().get_theme().get("value")
 	);
 }
@@ -1006,11 +1533,15 @@ bool keypress::react(::SDL_Event& event)
 		this->get_owner().set_focused(this);
 		return true;
 	} else if (event.type == SDL_KEYDOWN && this->get_owner().is_focused(this)) {
-		for (auto it = global::keycodes.begin(); it != global::keycodes.end(); ++it) {
-			if (it->second == event.key.keysym.sym) {
-				value_ = it->first;
-				return true;
-			}
+		const ::SDL_Keycode sym = event.key.keysym.sym;
+		auto pair = global::keynames.find(sym);
+		if (pair != global::keynames.end()) {
+			// A modifier on its own is a key, not a chord.
+			if (sym >= ::SDLK_LCTRL && sym <= ::SDLK_RGUI)
+				value_ = pair->second;
+			else
+				value_ = key_chord::mods_name(key_chord::mods_of(event.key.keysym.mod)) + pair->second;
+			return true;
 		}
 	}
 	return false;
@@ -43,6 +43,8 @@
 #include "pup_core.h"
 
 #include "pup_m.h"
+#include "pup_job.h"
+#include "pup_prf.h"
 #include "pup_app.h"
 
 namespace pup {
@@ -404,6 +406,194 @@ struct scoped_disable_lighting :
 	~scoped_disable_lighting() throw() { ::glEnable(GL_LIGHTING); }
 };
 
+// Measures the GPU time of a stretch of GL commands with a ring
+// of GL_TIME_ELAPSED queries. Results are only read once they
+// are available, a few frames late, so the pipeline never stalls.
+// A frame is not measured when all queries are still pending.
+class gpu_timer :
+	private boost::noncopyable
+{
+public:
+	explicit gpu_timer(size_type depth = 4);
+	~gpu_timer() throw();
+
+	static bool supported() throw();
+
+	void begin();
+	void end();
+
+	// Nanoseconds of the latest measured frame with a result, and
+	// the number of results so far.
+	::Sint64 get_last() const throw() { return last_; }
+	::Uint64 get_results() const throw() { return results_; }
+
+private:
+	void poll();
+
+	std::vector<::GLuint> queries_;
+	std::vector<bool> pending_;
+	size_type head_;
+	::Sint64 last_;
+	::Uint64 results_;
+	bool active_;
+};
+
+// Renders into an offscreen framebuffer at a fraction of the
+// window resolution and upscales the result into the window.
+// The fraction is adjusted between a minimum and a maximum to
+// keep the GPU time between %begin() and %end() within budget.
+// The framebuffer is allocated at the maximum fraction, only the
+// viewport changes with the scale.
+class resolution_scaler :
+	private boost::noncopyable
+{
+public:
+	explicit resolution_scaler(double min_scale = 0.5, double max_scale = 1.0,
+		::Sint64 budget = 16666667);
+	~resolution_scaler() throw();
+
+	static bool supported() throw();
+
+	void resize(int window_w, int window_h);
+
+	void begin();
+	void end();
+
+	void set_limits(double min_scale, double max_scale);
+	void set_budget(::Sint64 ns) throw() { budget_ = ns; }
+
+	double get_scale() const throw() { return scale_; }
+	int get_width() const throw() { return width_; }
+	int get_height() const throw() { return height_; }
+
+	// Smoothed GPU time in nanoseconds, zero until measured.
+	::Sint64 get_gpu_time() const throw() { return static_cast<::Sint64>(average_); }
+
+private:
+	void adapt();
+	void update_size() throw();
+
+	::GLuint fbo_;
+	::GLuint color_;
+	::GLuint depth_;
+	int window_w_;
+	int window_h_;
+	int width_;
+	int height_;
+	double min_;
+	double max_;
+	double scale_;
+	::Sint64 budget_;
+	double average_;
+	::Uint64 results_;
+	gpu_timer timer_;
+};
+
+// Measures the latency from input events to the swap of the
+// first frame rendered after them and, with a fence, to the GPU
+// finishing that frame. Fences are never waited on, only polled
+// by %poll(), so the GPU latency is an upper bound as accurate
+// as the polling points. A frame is not measured on the GPU when
+// all fences are still pending.
+class input_latency :
+	private boost::noncopyable
+{
+public:
+	explicit input_latency(size_type window = 1024, size_type depth = 8);
+	~input_latency() throw();
+
+	static bool fence_supported() throw();
+
+	// Disabling the fence deletes the pending ones, which needs
+	// the GL context.
+	void set_fence(bool enabled);
+	bool has_fence() const throw() { return fence_; }
+
+	// An input event at %prf::now() time. Inputs beyond the
+	// capacity of a frame are not measured.
+	void input(::Sint64 at) throw();
+
+	// Call right after the swap at %prf::now() time.
+	void swapped(::Sint64 at);
+
+	// Forget the inputs of a frame that is never swapped, e.g.
+	// while minimized, so they are not counted against the next.
+	void discard() throw();
+
+	void poll();
+
+	// Inputs presented by the latest swap and the longest latency
+	// among them.
+	size_type get_frame_inputs() const throw() { return frame_inputs_; }
+	::Sint64 get_frame_max() const throw() { return frame_max_; }
+
+	const prf::latency_window& get_swap_latency() const throw() { return swap_; }
+	const prf::latency_window& get_gpu_latency() const throw() { return gpu_; }
+
+	void set_window(size_type window);
+
+private:
+	struct frame
+	{
+		::GLsync fence;
+		std::vector<::Sint64> inputs;
+	};
+
+	void clear_fences() throw();
+
+	std::vector<::Sint64> pending_;
+	std::vector<frame> frames_;
+	size_type head_;
+	size_type count_;
+	size_type frame_inputs_;
+	::Sint64 frame_max_;
+	bool fence_;
+	prf::latency_window swap_;
+	prf::latency_window gpu_;
+};
+
+// The most frames a %frame_limiter lets the GPU queue.
+const size_type frame_limiter_depth = 3;
+
+// Keeps at most a given number of frames queued on the GPU. A
+// fence is inserted after every swap and %wait() blocks on the
+// fence of the frame that many frames ago, so input sampled after
+// %wait() is shown sooner at the cost of some throughput.
+class frame_limiter :
+	private boost::noncopyable
+{
+public:
+	explicit frame_limiter(size_type depth = 1, ::Sint64 timeout = 100000000);
+	~frame_limiter() throw();
+
+	static bool supported() throw();
+
+	// Call right after the swap.
+	void swapped();
+
+	// Block until fewer than depth frames are queued. A fence that
+	// is not signalled within the timeout is given up on.
+	void wait();
+
+	void set_depth(size_type depth) throw();
+	size_type get_depth() const throw() { return depth_; }
+	void set_timeout(::Sint64 ns) throw() { timeout_ = ns; }
+
+	::Sint64 get_last_wait() const throw() { return last_wait_; }
+	::Uint64 get_timeouts() const throw() { return timeouts_; }
+
+private:
+	void wait_oldest() throw();
+
+	std::array<::GLsync, frame_limiter_depth> fences_;
+	size_type head_;
+	size_type count_;
+	size_type depth_;
+	::Sint64 timeout_;
+	::Sint64 last_wait_;
+	::Uint64 timeouts_;
+};
+
 namespace ft {
 
 enum text_align {
@@ -415,6 +605,34 @@ enum text_align {
 class face;
 class typewriter;
 
+// A glyph rendered by FreeType, padded to power of two texture
+// dimensions and expanded to luminance-alpha.
+struct glyph
+{
+	glyph() :
+		width(0),
+		height(0),
+		bitmap_width(0),
+		bitmap_rows(0),
+		left(0),
+		top(0),
+		advance(0),
+		metrics_height(0)
+	{}
+
+	int width;
+	int height;
+	int bitmap_width;
+	int bitmap_rows;
+	int left;
+	int top;
+	int advance;
+	int metrics_height;
+	std::vector<::GLubyte> data;
+};
+
+typedef std::vector<glyph> glyph_vector;
+
 // FIXME: UTF-8 support not implemented, can only handle ASCII.
 class face :
 	private boost::noncopyable
@@ -427,12 +645,27 @@ public:
 		const rgb& c,
 		::GLfloat d
 	);
+
+	// Upload glyphs rendered by %rasterize().
+	explicit face(
+		const glyph_vector& glyphs,
+		int size,
+		const rgb& c,
+		::GLfloat d
+	);
 	virtual ~face() throw();
 
+	// Render all glyphs without touching GL, safe to call from any
+	// thread.
+	static void rasterize(typewriter& tw, const boost::filesystem::path& path,
+		int size, glyph_vector& glyphs);
+
 	virtual void print_2d(int x, int y, const std::string& text, const rgb& col);
 	virtual void print_2d(int x, int y, const std::string& text);
+	virtual void print_2d(int x, int y, const char* text, size_type n, const rgb& col);
 	
 	virtual ::GLuint text_width(const std::string& text);
+	virtual ::GLuint text_width(const char* text, size_type n);
 	virtual ::GLfloat text_height(const std::string& text);
 	virtual ::GLfloat line_height();
 
@@ -445,6 +678,9 @@ public:
 protected:
 	virtual void load_char(::FT_Face f, unsigned char ch);
 
+	static void rasterize_char(::FT_Face f, unsigned char ch, glyph& g);
+	void upload_char(unsigned char ch, const glyph& g);
+
 	const unsigned char first_char_;
 	const unsigned char last_char_;
 
@@ -466,19 +702,49 @@ class typewriter :
 	private boost::noncopyable
 {
 public:
+	struct font
+	{
+		explicit font(const boost::filesystem::path& p, int s,
+			const rgb& c = rgb(PUP_C3f_WHITE), ::GLfloat d = 1.0f) :
+			path(p),
+			size(s),
+			color(c),
+			divisor(d)
+		{}
+
+		boost::filesystem::path path;
+		int size;
+		rgb color;
+		::GLfloat divisor;
+	};
+
+	typedef std::vector<font> font_vector;
+
 	typewriter();
 	virtual ~typewriter() throw();
 
 	void load(const boost::filesystem::path& path, int size,
 		const rgb& c = rgb(PUP_C3f_WHITE), ::GLfloat d = 1.0f);
 
+	// Rasterize the fonts concurrently on the job system, then
+	// upload them on the calling thread, which must own the GL
+	// context.
+	void load(const font_vector& fonts, job::scheduler& js);
+
 	face_ptr& find_ptr(std::string name, int size);
 	face& find(std::string name, int size);
 	
 	::FT_Library get_lib() throw() { return lib_; }
 
+	// FreeType faces may be used concurrently, but creating and
+	// destroying them must be serialized.
+	std::mutex& get_lib_mutex() throw() { return lib_mutex_; }
+
 protected:
+	void insert(const boost::filesystem::path& path, int size, face_ptr f);
+
 	::FT_Library lib_;
+	std::mutex lib_mutex_;
 	face_map faces_;
 };
 
@@ -791,10 +1057,7 @@ public:
 	
 	virtual std::string string_value()
 	{
-		return boost::str(boost::format("text:%1%:%2%")
-			% name_
-			% label_
-		);
+		return "text:" + name_ + ":" + label_;
 	}
 
 protected:
@@ -859,10 +1122,7 @@ public:
 	
 	virtual std::string string_value()
 	{
-		return boost::str(boost::format("button:%1%:%2%")
-			% name_
-			% label_
-		);
+		return "button:" + name_ + ":" + label_;
 	}
 
 protected:
@@ -0,0 +1,432 @@
+
+// libPowerUP - Create games with SDL2 and OpenGL
+// Copyright(c) 2015, Erik Edlund <erik.edlund@32767.se>
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with
+// or without modification, are permitted provided that the
+// following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above
+//    copyright notice, this list of conditions and the
+//    following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above
+//    copyright notice, this list of conditions and the
+//    following disclaimer in the documentation and / or
+//    other materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names
+//    of its contributors may be used to endorse or promote
+//    products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES(INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+
+#include "pup_job.h"
+#include "pup_log.h"
+#include "pup_prf.h"
+
+namespace pup {
+namespace job {
+
+namespace {
+
+// Identifies the worker (if any) running on the current thread.
+thread_local const scheduler* current_scheduler = nullptr;
+thread_local size_type current_worker = 0;
+
+// Log the exception being handled, thrown by a job nobody waits
+// for.
+void log_failure() throw()
+{
+	try {
+		throw;
+	}
+	catch (const std::exception& e) {
+		PUP_LOG(error) << boost::format("job failed: %1%")
+			% e.what();
+	}
+	catch (...) {
+		PUP_LOG(error) << "job failed";
+	}
+}
+
+} // anonymous
+
+scheduler::scheduler(size_type workers) :
+	pending_(0),
+	next_(0),
+	quit_(false)
+{
+	if (!workers) {
+		const size_type hw = std::thread::hardware_concurrency();
+		workers = hw > 1? hw - 1: 1;
+	}
+
+	for (size_type i = 0; i < workers; ++i)
+		workers_.push_back(std::unique_ptr<worker>(new worker()));
+	for (size_type i = 0; i < workers; ++i)
+		workers_[i]->thread = std::thread(&scheduler::work, this, i);
+}
+
+scheduler::~scheduler() throw()
+{
+	{
+		std::lock_guard<std::mutex> lock(sleep_mutex_);
+		quit_ = true;
+	}
+	sleep_cond_.notify_all();
+
+	for (auto it = workers_.begin(); it != workers_.end(); ++it)
+		(*it)->thread.join();
+}
+
+void scheduler::submit(const task_function& task, counter* c)
+{
+	if (c)
+		c->value_++;
+
+	job j = { task, c };
+	this->push(j);
+}
+
+void scheduler::then(counter& c, const task_function& task, counter* next)
+{
+	if (next)
+		next->value_++;
+
+	std::exception_ptr error;
+	{
+		std::lock_guard<std::mutex> lock(c.mutex_);
+		if (c.value_ != 0) {
+			c.continuations_.push_back(std::make_pair(task, next));
+			return;
+		}
+		error = c.error_;
+	}
+	if (next && error) {
+		std::lock_guard<std::mutex> lock(next->mutex_);
+		if (!next->error_)
+			next->error_ = error;
+	}
+
+	job j = { task, next };
+	this->push(j);
+}
+
+void scheduler::wait(counter& c)
+{
+	const size_type self = current_scheduler == this?
+		current_worker: workers_.size();
+
+	while (!c.done()) {
+		job j;
+		if (this->pop(self, j))
+			this->execute(j);
+		else
+			std::this_thread::yield();
+	}
+
+	std::exception_ptr error;
+	{
+		std::lock_guard<std::mutex> lock(c.mutex_);
+		error.swap(c.error_);
+	}
+	if (error)
+		std::rethrow_exception(error);
+}
+
+void scheduler::parallel_for(size_type begin, size_type end, size_type grain,
+	const range_function& fn)
+{
+	if (begin >= end)
+		return;
+
+	if (!grain)
+		grain = std::max<size_type>((end - begin) / (workers_.size() * 4), 1);
+
+	counter c;
+	for (size_type first = begin; first < end; first += grain) {
+		const size_type last = std::min(first + grain, end);
+		this->submit(boost::bind(fn, first, last), &c);
+	}
+	this->wait(c);
+}
+
+worker_stats scheduler::get_stats(size_type worker) const
+{
+	if (worker >= workers_.size())
+		PUP_ERR(std::out_of_range, "invalid worker index");
+
+	worker_stats stats;
+	stats.jobs = workers_[worker]->jobs.load();
+	stats.steals = workers_[worker]->steals.load();
+	stats.busy_ns = workers_[worker]->busy_ns.load();
+	stats.idle_ns = workers_[worker]->idle_ns.load();
+	return stats;
+}
+
+void scheduler::reset_stats() throw()
+{
+	for (auto it = workers_.begin(); it != workers_.end(); ++it) {
+		(*it)->jobs = 0;
+		(*it)->steals = 0;
+		(*it)->busy_ns = 0;
+		(*it)->idle_ns = 0;
+	}
+}
+
+// Jobs submitted by a worker go to its own queue, others are
+// distributed round-robin.
+void scheduler::push(const job& j)
+{
+	const size_type index = current_scheduler == this?
+		current_worker: next_++ % workers_.size();
+
+	// Counted before the job is visible, a thief popping it right
+	// away must not take the count below zero.
+	pending_++;
+	{
+		std::lock_guard<std::mutex> lock(workers_[index]->mutex);
+		workers_[index]->queue.push_back(j);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(sleep_mutex_);
+	}
+	sleep_cond_.notify_one();
+}
+
+bool scheduler::pop(size_type self, job& j)
+{
+	const size_type n = workers_.size();
+
+	if (self < n) {
+		worker& w(*workers_[self]);
+		std::lock_guard<std::mutex> lock(w.mutex);
+		if (!w.queue.empty()) {
+			j = w.queue.back();
+			w.queue.pop_back();
+			pending_--;
+			return true;
+		}
+	}
+
+	for (size_type i = 1; i <= n; ++i) {
+		worker& victim(*workers_[(self + i) % n]);
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (!victim.queue.empty()) {
+			j = victim.queue.front();
+			victim.queue.pop_front();
+			pending_--;
+			if (self < n)
+				workers_[self]->steals++;
+			return true;
+		}
+	}
+	return false;
+}
+
+// Never throws. An exception is kept in the counter of the job,
+// whose waiter rethrows it once every job of the counter is done,
+// so that a thread running jobs while waiting never sees the
+// exceptions of jobs it does not wait for.
+void scheduler::execute(job& j)
+{
+	PUP_ZONE("job::scheduler::execute");
+
+	try {
+		j.task();
+	}
+	catch (...) {
+		if (j.c) {
+			std::lock_guard<std::mutex> lock(j.c->mutex_);
+			if (!j.c->error_)
+				j.c->error_ = std::current_exception();
+		} else {
+			log_failure();
+		}
+	}
+	this->finish(j.c);
+}
+
+void scheduler::finish(counter* c)
+{
+	if (!c)
+		return;
+
+	// The counter must not be touched once the lock is released
+	// after the last decrement, see %counter::done().
+	counter::continuation_vector continuations;
+	std::exception_ptr error;
+	{
+		std::lock_guard<std::mutex> lock(c->mutex_);
+		if (--c->value_ != 0)
+			return;
+		continuations.swap(c->continuations_);
+		error = c->error_;
+	}
+	for (auto it = continuations.begin(); it != continuations.end(); ++it) {
+		if (error && it->second) {
+			std::lock_guard<std::mutex> lock(it->second->mutex_);
+			if (!it->second->error_)
+				it->second->error_ = error;
+		}
+		job j = { it->first, it->second };
+		this->push(j);
+	}
+}
+
+void scheduler::work(size_type index)
+{
+	current_scheduler = this;
+	current_worker = index;
+
+	PUP_THREAD_NAME("job worker");
+
+	worker& self(*workers_[index]);
+	::Sint64 mark = prf::now();
+
+	// Only quit once the queues are empty. Jobs pushed by a running
+	// job go to the queue of its own worker, which is still running.
+	for (;;) {
+		job j;
+		if (this->pop(index, j)) {
+			const ::Sint64 start = prf::now();
+			self.idle_ns += start - mark;
+			this->execute(j);
+			mark = prf::now();
+			self.busy_ns += mark - start;
+			self.jobs++;
+		} else {
+			std::unique_lock<std::mutex> lock(sleep_mutex_);
+			if (quit_ && !pending_)
+				break;
+			sleep_cond_.wait(lock, [this]() { return pending_ > 0 || quit_; });
+		}
+	}
+}
+
+graph::graph() :
+	running_(0),
+	total_(0)
+{
+}
+
+graph::~graph() throw()
+{
+	for (auto it = threads_.begin(); it != threads_.end(); ++it) {
+		if (it->joinable())
+			it->join();
+	}
+}
+
+graph::node graph::add(const std::string& name, const task_function& task,
+	const node_vector& deps, bool main_thread)
+{
+	const node n = nodes_.size();
+	vertex v = { name, task, node_vector(), deps.size(), main_thread, 0 };
+
+	for (auto it = deps.begin(); it != deps.end(); ++it) {
+		if (*it >= n)
+			PUP_ERR(std::logic_error, boost::str(boost::format(
+				"phase \"%1%\" depends on an unknown phase") % name));
+		nodes_[*it].dependents.push_back(n);
+	}
+	nodes_.push_back(v);
+	return n;
+}
+
+void graph::run()
+{
+	const ::Sint64 begin = prf::now();
+
+	std::unique_lock<std::mutex> lock(mutex_);
+
+	for (node n = 0; n < nodes_.size(); ++n) {
+		if (!nodes_[n].deps)
+			this->start(n);
+	}
+
+	for (;;) {
+		if (!ready_.empty() && !error_) {
+			const node n = ready_.front();
+			ready_.pop_front();
+			lock.unlock();
+			this->execute(n);
+			lock.lock();
+			continue;
+		}
+		if (!running_ && (ready_.empty() || error_))
+			break;
+		cond_.wait(lock);
+	}
+	lock.unlock();
+
+	for (auto it = threads_.begin(); it != threads_.end(); ++it)
+		it->join();
+	threads_.clear();
+
+	total_ = prf::now() - begin;
+
+	if (error_)
+		std::rethrow_exception(error_);
+}
+
+// Called with the mutex held.
+void graph::start(node n)
+{
+	if (nodes_[n].main_thread) {
+		ready_.push_back(n);
+	} else {
+		running_++;
+		threads_.push_back(std::thread(&graph::execute, this, n));
+	}
+}
+
+void graph::execute(node n)
+{
+	const ::Sint64 begin = prf::now();
+	std::exception_ptr error;
+
+	try {
+		nodes_[n].task();
+	}
+	catch (...) {
+		error = std::current_exception();
+	}
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	vertex& v(nodes_[n]);
+	v.duration = prf::now() - begin;
+	if (!v.main_thread)
+		running_--;
+
+	if (error) {
+		if (!error_)
+			error_ = error;
+	} else if (!error_) {
+		for (auto it = v.dependents.begin(); it != v.dependents.end(); ++it) {
+			if (--nodes_[*it].deps == 0)
+				this->start(*it);
+		}
+	}
+	cond_.notify_all();
+}
+
+} // job
+} // pup
@@ -0,0 +1,244 @@
+
+// libPowerUP - Create games with SDL2 and OpenGL
+// Copyright(c) 2015, Erik Edlund <erik.edlund@32767.se>
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with
+// or without modification, are permitted provided that the
+// following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above
+//    copyright notice, this list of conditions and the
+//    following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above
+//    copyright notice, this list of conditions and the
+//    following disclaimer in the documentation and / or
+//    other materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names
+//    of its contributors may be used to endorse or promote
+//    products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES(INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+
+#ifndef LIBPUP_PUP_JOB_H
+#define LIBPUP_PUP_JOB_H
+
+#include "pup_env.h"
+#include "pup_core.h"
+
+namespace pup {
+namespace job {
+
+typedef boost::function<void ()> task_function;
+typedef boost::function<void (size_type, size_type)> range_function;
+
+class scheduler;
+
+// Counts outstanding jobs. Continuations attached with
+// %scheduler::then() are submitted once it drops to zero. The
+// first exception thrown by one of its jobs is kept and rethrown
+// by %scheduler::wait(), and passed on to the counters of its
+// continuations.
+class counter :
+	private boost::noncopyable
+{
+public:
+	counter() :
+		value_(0)
+	{}
+
+	inline size_type get() const throw() { return value_.load(); }
+
+	// Synchronizes with the job finishing last, the counter may be
+	// destroyed as soon as this has returned true.
+	inline bool done() const
+	{
+		if (value_.load())
+			return false;
+		std::lock_guard<std::mutex> lock(mutex_);
+		return value_.load() == 0;
+	}
+
+private:
+	friend class scheduler;
+
+	typedef std::vector<std::pair<task_function, counter*>> continuation_vector;
+
+	std::atomic<size_type> value_;
+	mutable std::mutex mutex_;
+	continuation_vector continuations_;
+	std::exception_ptr error_;
+};
+
+// Per-worker statistics, accumulated since the scheduler was
+// created or %scheduler::reset_stats() was last called.
+struct worker_stats
+{
+	worker_stats() :
+		jobs(0),
+		steals(0),
+		busy_ns(0),
+		idle_ns(0)
+	{}
+
+	inline double utilization() const throw()
+	{
+		const ::Sint64 total = busy_ns + idle_ns;
+		return total? static_cast<double>(busy_ns) / total: 0.0;
+	}
+
+	::Uint64 jobs;
+	::Uint64 steals;
+	::Sint64 busy_ns;
+	::Sint64 idle_ns;
+};
+
+// A work-stealing thread pool. Every worker owns a queue which
+// it pops from the back, idle workers steal from the front of
+// the queues of other workers. Threads waiting for a counter
+// execute pending jobs instead of blocking. A job that throws
+// and has no counter is logged. Destroying the scheduler runs
+// the jobs still queued before the workers are joined.
+class scheduler :
+	private boost::noncopyable
+{
+public:
+	// Zero workers means one less than the number of hardware
+	// threads, but at least one.
+	explicit scheduler(size_type workers = 0);
+	~scheduler() throw();
+
+	void submit(const task_function& task, counter* c = nullptr);
+	void then(counter& c, const task_function& task, counter* next = nullptr);
+
+	// Rethrows the first exception of the jobs of the counter,
+	// once all of them are done.
+	void wait(counter& c);
+
+	// Call fn(first, last) for consecutive sub-ranges of
+	// [begin, end) of at most grain indices each and wait for
+	// all of them to finish. A grain of zero picks one based
+	// on the number of workers.
+	void parallel_for(size_type begin, size_type end, size_type grain,
+		const range_function& fn);
+
+	size_type get_worker_count() const throw() { return workers_.size(); }
+	worker_stats get_stats(size_type worker) const;
+	void reset_stats() throw();
+
+private:
+	struct job
+	{
+		task_function task;
+		counter* c;
+	};
+
+	struct worker
+	{
+		worker() :
+			jobs(0),
+			steals(0),
+			busy_ns(0),
+			idle_ns(0)
+		{}
+
+		std::deque<job> queue;
+		std::mutex mutex;
+		std::thread thread;
+
+		std::atomic<::Uint64> jobs;
+		std::atomic<::Uint64> steals;
+		std::atomic<::Sint64> busy_ns;
+		std::atomic<::Sint64> idle_ns;
+	};
+
+	typedef std::vector<std::unique_ptr<worker>> worker_vector;
+
+	void push(const job& j);
+	bool pop(size_type self, job& j);
+	void execute(job& j);
+	void finish(counter* c);
+	void work(size_type index);
+
+	worker_vector workers_;
+	std::mutex sleep_mutex_;
+	std::condition_variable sleep_cond_;
+	std::atomic<size_type> pending_;
+	std::atomic<size_type> next_;
+	std::atomic<bool> quit_;
+};
+
+// Runs named phases once, each as soon as the phases it depends
+// on are done. Phases not bound to the calling thread run
+// concurrently on threads of their own, so a graph can be run
+// before a %scheduler exists, e.g. during startup. Phases can
+// only depend on phases added before them.
+class graph :
+	private boost::noncopyable
+{
+public:
+	typedef size_type node;
+	typedef std::vector<node> node_vector;
+
+	graph();
+	~graph() throw();
+
+	node add(const std::string& name, const task_function& task,
+		const node_vector& deps = node_vector(), bool main_thread = false);
+
+	// Blocks until every phase is done. If a phase throws, no
+	// further phases are started and the exception is rethrown
+	// once the running ones are done.
+	void run();
+
+	size_type size() const throw() { return nodes_.size(); }
+	const std::string& get_name(node n) const { return nodes_.at(n).name; }
+
+	// Nanoseconds spent in a phase, and in %run() as a whole.
+	::Sint64 get_duration(node n) const { return nodes_.at(n).duration; }
+	::Sint64 get_total() const throw() { return total_; }
+
+private:
+	struct vertex
+	{
+		std::string name;
+		task_function task;
+		node_vector dependents;
+		size_type deps;
+		bool main_thread;
+		::Sint64 duration;
+	};
+
+	void start(node n);
+	void execute(node n);
+
+	std::vector<vertex> nodes_;
+	std::vector<std::thread> threads_;
+	std::deque<node> ready_;
+	std::mutex mutex_;
+	std::condition_variable cond_;
+	std::exception_ptr error_;
+	size_type running_;
+	::Sint64 total_;
+};
+
+} // job
+} // pup
+
+#endif
@@ -0,0 +1,479 @@
+
+// libPowerUP - Create games with SDL2 and OpenGL
+// Copyright(c) 2015, Erik Edlund <erik.edlund@32767.se>
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with
+// or without modification, are permitted provided that the
+// following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above
+//    copyright notice, this list of conditions and the
+//    following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above
+//    copyright notice, this list of conditions and the
+//    following disclaimer in the documentation and / or
+//    other materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names
+//    of its contributors may be used to endorse or promote
+//    products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES(INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+
+#include "pup_log.h"
+
+#include <csignal>
+
+#ifdef PUP_NIX
+#include <unistd.h>
+#endif
+
+namespace pup {
+namespace log {
+
+namespace {
+
+struct record
+{
+	std::atomic<size_type> sequence;
+	severity sev;
+	format_function format;
+	size_type length;
+	alignas(std::max_align_t) char data[record_size];
+};
+
+// A bounded multi-producer queue (Dmitry Vyukov's). Each record
+// carries a sequence number telling whether it is free for the
+// producer at a position or ready for the consumer. There is a
+// single consumer at a time, guarded by %consuming.
+struct record_queue
+{
+	record_queue() :
+		records(new record[queue_capacity]),
+		head(0),
+		tail(0),
+		dropped(0),
+		reported(0),
+		writers(0),
+		running(false)
+	{
+		for (size_type i = 0; i < queue_capacity; ++i)
+			records[i].sequence.store(i, std::memory_order_relaxed);
+		consuming.clear();
+	}
+
+	std::unique_ptr<record[]> records;
+	std::atomic<size_type> head;
+	std::atomic<size_type> tail;
+	std::atomic<size_type> dropped;
+	std::atomic<size_type> reported;
+	std::atomic<size_type> writers;
+	std::atomic<bool> running;
+	std::atomic_flag consuming;
+	std::thread thread;
+};
+
+static_assert((queue_capacity & (queue_capacity - 1)) == 0,
+	"the queue capacity must be a power of two");
+
+record_queue& queue()
+{
+	static record_queue q;
+	return q;
+}
+
+// Held by a producer from seeing the backend running until its
+// record is queued, so that %stop() can wait for it before the
+// final flush.
+class writer_scope :
+	private boost::noncopyable
+{
+public:
+	explicit writer_scope(record_queue& q) throw() : q_(q) { q_.writers++; }
+	~writer_scope() throw() { q_.writers--; }
+
+private:
+	record_queue& q_;
+};
+
+class array_buf :
+	public std::streambuf
+{
+public:
+	array_buf(char* buffer, size_type size)
+	{
+		this->setp(buffer, buffer + size);
+	}
+
+	size_type size() const { return this->pptr() - this->pbase(); }
+};
+
+const int crash_signals[] = {
+	SIGABRT,
+	SIGFPE,
+	SIGILL,
+	SIGSEGV
+};
+
+typedef void (*signal_handler)(int);
+
+signal_handler previous_handlers[sizeof(crash_signals) / sizeof(crash_signals[0])];
+std::terminate_handler previous_terminate = nullptr;
+
+std::atomic<severity> threshold(boost::log::trivial::trace);
+
+record* reserve() throw()
+{
+	record_queue& q(queue());
+	size_type pos = q.tail.load(std::memory_order_relaxed);
+
+	for (;;) {
+		record& r(q.records[pos & (queue_capacity - 1)]);
+		const size_type seq = r.sequence.load(std::memory_order_acquire);
+		const std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(seq - pos);
+
+		if (diff == 0) {
+			if (q.tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				return &r;
+		} else if (diff < 0) {
+			q.dropped.fetch_add(1, std::memory_order_relaxed);
+			return nullptr;
+		} else {
+			pos = q.tail.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+inline void commit(record* r) throw()
+{
+	r->sequence.store(r->sequence.load(std::memory_order_relaxed) + 1,
+		std::memory_order_release);
+}
+
+// Format a record into the buffer, returning its length.
+size_type format(const record& r, char* buffer, size_type size) throw()
+{
+	if (!r.format) {
+		const size_type n = std::min(r.length, size);
+		std::memcpy(buffer, r.data, n);
+		return n;
+	}
+
+	array_buf buf(buffer, size);
+	try {
+		std::ostream ostr(&buf);
+		r.format(ostr, r.data);
+	}
+	catch (...) {
+	}
+	return buf.size();
+}
+
+void to_boost_log(severity sev, const char* text, size_type length) throw()
+{
+	try {
+		BOOST_LOG_SEV(boost::log::trivial::logger::get(), sev).write(text, length);
+	}
+	catch (...) {
+	}
+}
+
+void to_boost_log(const record& r) throw()
+{
+	char buffer[record_size];
+	to_boost_log(r.sev, buffer, format(r, buffer, sizeof(buffer)));
+}
+
+void to_stderr(const record& r) throw()
+{
+	char buffer[record_size];
+	std::fprintf(stderr, "[%s] %.*s\n", boost::log::trivial::to_string(r.sev),
+		static_cast<int>(format(r, buffer, sizeof(buffer))), buffer);
+}
+
+void write_stderr(const char* text, size_type length) throw()
+{
+#ifdef PUP_NIX
+	while (length) {
+		const ssize_t n = ::write(STDERR_FILENO, text, length);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return;
+		text += n;
+		length -= n;
+	}
+#else
+	std::fwrite(text, 1, length, stderr);
+#endif
+}
+
+// Async-signal-safe. Lazy records are skipped, formatting them
+// may allocate or take locks.
+void to_stderr_raw(const record& r) throw()
+{
+	static const char* const names[] = {
+		"[trace] ", "[debug] ", "[info] ", "[warning] ", "[error] ", "[fatal] "
+	};
+
+	if (r.format)
+		return;
+	const size_type sev = static_cast<size_type>(r.sev);
+	const char* name = sev < sizeof(names) / sizeof(names[0])? names[sev]: "[?] ";
+	write_stderr(name, std::strlen(name));
+	write_stderr(r.data, r.length);
+	write_stderr("\n", 1);
+}
+
+// Consume queued records, unless another thread is consuming.
+// Returns the number of records written.
+size_type drain(void (*sink)(const record&)) throw()
+{
+	record_queue& q(queue());
+
+	if (q.consuming.test_and_set(std::memory_order_acquire))
+		return 0;
+
+	size_type count = 0;
+
+	for (;;) {
+		const size_type pos = q.head.load(std::memory_order_relaxed);
+		record& r(q.records[pos & (queue_capacity - 1)]);
+
+		if (r.sequence.load(std::memory_order_acquire) != pos + 1)
+			break;
+
+		sink(r);
+
+		q.head.store(pos + 1, std::memory_order_relaxed);
+		r.sequence.store(pos + queue_capacity, std::memory_order_release);
+		++count;
+	}
+
+	q.consuming.clear(std::memory_order_release);
+	return count;
+}
+
+void report_dropped() throw()
+{
+	record_queue& q(queue());
+	const size_type dropped = q.dropped.load(std::memory_order_relaxed);
+	const size_type reported = q.reported.exchange(dropped);
+
+	if (dropped != reported) {
+		try {
+			BOOST_LOG_TRIVIAL(warning) << boost::format("dropped %1% log records")
+				% (dropped - reported);
+		}
+		catch (...) {
+		}
+	}
+}
+
+void run_backend()
+{
+	record_queue& q(queue());
+
+	while (q.running.load(std::memory_order_acquire)) {
+		report_dropped();
+		if (!drain(&to_boost_log))
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+}
+
+// Only the queue is touched, the records that are left are
+// written to stderr as Boost.Log may not survive a crash. Best
+// effort: if another thread is consuming, e.g. the one that
+// crashed, it is retried for a while and then given up.
+void crash_flush(void (*sink)(const record&)) throw()
+{
+	for (int i = 0; i < (1 << 20) && !drain(sink); ++i) {
+		if (!get_pending())
+			break;
+	}
+}
+
+// Chain to the handler installed before %start(), which is the
+// default action unless the application had its own.
+void on_crash_signal(int sig)
+{
+	crash_flush(&to_stderr_raw);
+
+	signal_handler previous = SIG_DFL;
+	for (size_type i = 0; i < sizeof(crash_signals) / sizeof(crash_signals[0]); ++i) {
+		if (crash_signals[i] == sig && previous_handlers[i] != SIG_ERR)
+			previous = previous_handlers[i];
+	}
+	std::signal(sig, previous);
+	std::raise(sig);
+}
+
+void on_terminate()
+{
+	crash_flush(&to_stderr);
+	std::fflush(stderr);
+	if (previous_terminate)
+		previous_terminate();
+	std::abort();
+}
+
+} // anonymous
+
+void set_threshold(severity sev)
+{
+	threshold.store(sev, std::memory_order_relaxed);
+	boost::log::core::get()->set_filter(boost::log::trivial::severity >= sev);
+}
+
+severity get_threshold() throw()
+{
+	return threshold.load(std::memory_order_relaxed);
+}
+
+bool enabled(severity sev) throw()
+{
+	return sev >= threshold.load(std::memory_order_relaxed) &&
+		boost::log::core::get()->get_logging_enabled();
+}
+
+void write(severity sev, const char* text, size_type length) throw()
+{
+	record_queue& q(queue());
+
+	if (!enabled(sev))
+		return;
+	writer_scope scope(q);
+	if (!q.running.load()) {
+		to_boost_log(sev, text, length);
+		return;
+	}
+	if (length > record_size) {
+		flush();
+		to_boost_log(sev, text, length);
+		return;
+	}
+
+	record* r = reserve();
+	if (!r)
+		return;
+	r->sev = sev;
+	r->format = nullptr;
+	r->length = length;
+	std::memcpy(r->data, text, r->length);
+	commit(r);
+}
+
+void write_lazy(severity sev, format_function format, const void* data, size_type size) throw()
+{
+	record_queue& q(queue());
+
+	if (!enabled(sev))
+		return;
+	writer_scope scope(q);
+	if (!q.running.load()) {
+		char buffer[record_size];
+		array_buf buf(buffer, sizeof(buffer));
+		try {
+			std::ostream ostr(&buf);
+			format(ostr, data);
+		}
+		catch (...) {
+		}
+		to_boost_log(sev, buffer, buf.size());
+		return;
+	}
+
+	record* r = reserve();
+	if (!r)
+		return;
+	r->sev = sev;
+	r->format = format;
+	r->length = size;
+	std::memcpy(r->data, data, size);
+	commit(r);
+}
+
+size_type get_pending() throw()
+{
+	record_queue& q(queue());
+	return q.tail.load() - q.head.load();
+}
+
+size_type get_dropped() throw()
+{
+	return queue().dropped.load();
+}
+
+void flush() throw()
+{
+	while (get_pending()) {
+		if (!drain(&to_boost_log))
+			std::this_thread::yield();
+	}
+}
+
+void start()
+{
+	record_queue& q(queue());
+
+	if (q.running.exchange(true))
+		return;
+	q.thread = std::thread(&run_backend);
+
+	for (size_type i = 0; i < sizeof(crash_signals) / sizeof(crash_signals[0]); ++i)
+		previous_handlers[i] = std::signal(crash_signals[i], &on_crash_signal);
+	previous_terminate = std::set_terminate(&on_terminate);
+}
+
+void stop() throw()
+{
+	record_queue& q(queue());
+
+	if (!q.running.exchange(false))
+		return;
+	q.thread.join();
+
+	// Producers that saw the backend running may still be queuing.
+	while (q.writers.load())
+		std::this_thread::yield();
+
+	for (size_type i = 0; i < sizeof(crash_signals) / sizeof(crash_signals[0]); ++i)
+		std::signal(crash_signals[i], previous_handlers[i]);
+	std::set_terminate(previous_terminate);
+
+	flush();
+	report_dropped();
+}
+
+stream::stream(severity sev) throw() :
+	sev_(sev),
+	enabled_(enabled(sev)),
+	ostr_(this)
+{
+	this->setp(buffer_, buffer_ + record_size);
+}
+
+stream::~stream() throw()
+{
+	if (enabled_)
+		write(sev_, buffer_, this->pptr() - this->pbase());
+}
+
+} // log
+} // pup
@@ -0,0 +1,166 @@
+
+// libPowerUP - Create games with SDL2 and OpenGL
+// Copyright(c) 2015, Erik Edlund <erik.edlund@32767.se>
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with
+// or without modification, are permitted provided that the
+// following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above
+//    copyright notice, this list of conditions and the
+//    following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above
+//    copyright notice, this list of conditions and the
+//    following disclaimer in the documentation and / or
+//    other materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names
+//    of its contributors may be used to endorse or promote
+//    products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES(INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+
+#ifndef LIBPUP_PUP_LOG_H
+#define LIBPUP_PUP_LOG_H
+
+#include "pup_env.h"
+#include "pup_core.h"
+
+// Log a record, formatted with operator<< into a fixed buffer on
+// the calling thread, e.g. PUP_LOG(info) << "loaded " << n;
+// Nothing is formatted unless the severity is %enabled().
+#define PUP_LOG(Severity) \
+	pup::log::stream(boost::log::trivial::Severity)
+
+namespace pup {
+namespace log {
+
+typedef boost::log::trivial::severity_level severity;
+
+// Records formatted with %PUP_LOG are truncated to %record_size
+// bytes. Longer text passed to %write() is written at once.
+const size_type record_size = 512;
+const size_type queue_capacity = 4096;
+
+typedef void (*format_function)(std::ostream& ostr, const void* data);
+
+// Records below the threshold are discarded before they are
+// formatted or queued. Setting it also installs the matching
+// severity filter in the Boost.Log core. Other core filters are
+// only applied when queued records are written.
+void set_threshold(severity sev);
+severity get_threshold() throw();
+
+// False if a record of the severity would be discarded.
+bool enabled(severity sev) throw();
+
+// Queue a record. When the backend is running this never blocks
+// nor allocates, and a full queue drops the record instead.
+// Without the backend, or when the text does not fit in a record,
+// it is written to Boost.Log at once.
+void write(severity sev, const char* text, size_type length) throw();
+
+inline void write(severity sev, const std::string& text) throw()
+{
+	write(sev, text.data(), text.size());
+}
+
+// Queue a record that is formatted by the backend thread, by
+// calling %format with a copy of %size bytes of %data.
+void write_lazy(severity sev, format_function format, const void* data, size_type size) throw();
+
+namespace detail {
+
+template <typename Format>
+void call_format(std::ostream& ostr, const void* data)
+{
+	(*static_cast<const Format*>(data))(ostr);
+}
+
+} // detail
+
+// Queue a callable taking a std::ostream& which is formatted by
+// the backend thread. It is copied bytewise, so it must be
+// trivially copyable: capture numbers and string literals by
+// value, never references to data that may change.
+template <typename Format>
+void write_lazy(severity sev, const Format& format) throw()
+{
+	static_assert(std::is_trivially_copyable<Format>::value,
+		"lazily formatted records must be trivially copyable");
+	static_assert(sizeof(Format) <= record_size,
+		"lazily formatted records must fit in a record");
+	write_lazy(sev, &detail::call_format<Format>, &format, sizeof(Format));
+}
+
+// Records queued and not yet written, or dropped since startup.
+size_type get_pending() throw();
+size_type get_dropped() throw();
+
+// Write all queued records on the calling thread.
+void flush() throw();
+
+// Starts the backend thread, which writes queued records to
+// Boost.Log, and installs handlers that flush the queue to stderr
+// on fatal signals and std::terminate(). Stopping flushes the
+// queue and restores the handlers.
+//
+// Queued records reach Boost.Log on the backend thread, so time
+// stamps and thread ids added by sinks or global attributes are
+// those of the backend thread, not of the thread that logged.
+void start();
+void stop() throw();
+
+class scoped_backend :
+	private boost::noncopyable
+{
+public:
+	scoped_backend() { log::start(); }
+	~scoped_backend() throw() { log::stop(); }
+};
+
+// Formats into a fixed buffer and queues the record when
+// destroyed, see %PUP_LOG.
+class stream :
+	private std::streambuf,
+	private boost::noncopyable
+{
+public:
+	explicit stream(severity sev) throw();
+	~stream() throw();
+
+	template <typename T>
+	stream& operator<<(const T& value)
+	{
+		if (enabled_)
+			ostr_ << value;
+		return *this;
+	}
+
+private:
+	severity sev_;
+	bool enabled_;
+	char buffer_[record_size];
+	std::ostream ostr_;
+};
+
+} // log
+} // pup
+
+#endif
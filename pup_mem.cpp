@@ -0,0 +1,475 @@
+
+// libPowerUP - Create games with SDL2 and OpenGL
+// Copyright(c) 2015, Erik Edlund <erik.edlund@32767.se>
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with
+// or without modification, are permitted provided that the
+// following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above
+//    copyright notice, this list of conditions and the
+//    following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above
+//    copyright notice, this list of conditions and the
+//    following disclaimer in the documentation and / or
+//    other materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names
+//    of its contributors may be used to endorse or promote
+//    products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES(INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+
+#include "pup_mem.h"
+
+#if defined(PUP_TRACK_ALLOC) && defined(PUP_NIX)
+#include <execinfo.h>
+#endif
+
+namespace pup {
+namespace mem {
+
+#ifdef PUP_TRACK_ALLOC
+
+namespace {
+
+const size_type zone_slots = 256;
+const size_type stack_slots = 1024;
+const int stack_depth = 16;
+
+// Everything is statically allocated and lock-free, as it is
+// used from within operator new.
+struct alloc_counters
+{
+	std::atomic<size_type> allocs;
+	std::atomic<size_type> frees;
+	std::atomic<size_type> bytes;
+	std::atomic<size_type> live;
+	std::atomic<size_type> peak;
+};
+
+struct zone_slot
+{
+	std::atomic<const char*> name;
+	std::atomic<size_type> allocs;
+	std::atomic<size_type> bytes;
+};
+
+// Claimed by storing a nonzero hash, complete once ready is set.
+struct stack_slot
+{
+	std::atomic<std::uint64_t> hash;
+	std::atomic<bool> ready;
+	void* frames[stack_depth];
+	int depth;
+	std::atomic<size_type> samples;
+	std::atomic<size_type> bytes;
+};
+
+alloc_counters frame_counters;
+alloc_counters total_counters;
+zone_slot zones[zone_slots];
+stack_slot stacks[stack_slots];
+
+thread_local bool in_hook = false;
+thread_local const char* current_zone = nullptr;
+thread_local size_type sample_countdown = alloc_sample_period;
+
+inline void raise_peak(std::atomic<size_type>& peak, size_type live) throw()
+{
+	size_type p = peak.load(std::memory_order_relaxed);
+	while (live > p && !peak.compare_exchange_weak(p, live, std::memory_order_relaxed))
+		;
+}
+
+inline void count_alloc(alloc_counters& c, size_type size) throw()
+{
+	c.allocs.fetch_add(1, std::memory_order_relaxed);
+	c.bytes.fetch_add(size, std::memory_order_relaxed);
+	raise_peak(c.peak, c.live.fetch_add(size, std::memory_order_relaxed) + size);
+}
+
+inline void count_free(alloc_counters& c, size_type size) throw()
+{
+	c.frees.fetch_add(1, std::memory_order_relaxed);
+	c.live.fetch_sub(size, std::memory_order_relaxed);
+}
+
+void count_zone(const char* name, size_type size) throw()
+{
+	const size_type start = (reinterpret_cast<std::uintptr_t>(name) >> 3) % zone_slots;
+
+	for (size_type i = 0; i < zone_slots; ++i) {
+		zone_slot& z(zones[(start + i) % zone_slots]);
+		const char* n = z.name.load(std::memory_order_acquire);
+		if (!n && z.name.compare_exchange_strong(n, name, std::memory_order_acq_rel))
+			n = name;
+		if (n == name) {
+			z.allocs.fetch_add(1, std::memory_order_relaxed);
+			z.bytes.fetch_add(size, std::memory_order_relaxed);
+			return;
+		}
+	}
+}
+
+void sample_stack(size_type size) throw()
+{
+#ifdef PUP_NIX
+	void* frames[stack_depth];
+	const int depth = ::backtrace(frames, stack_depth);
+
+	std::uint64_t hash = 14695981039346656037ULL;
+	for (int i = 0; i < depth; ++i)
+		hash = (hash ^ reinterpret_cast<std::uintptr_t>(frames[i])) * 1099511628211ULL;
+	hash |= 1;
+
+	for (size_type i = 0; i < stack_slots; ++i) {
+		stack_slot& s(stacks[(hash + i) % stack_slots]);
+		std::uint64_t h = s.hash.load(std::memory_order_acquire);
+		if (!h && s.hash.compare_exchange_strong(h, hash, std::memory_order_acq_rel)) {
+			std::copy(frames, frames + depth, s.frames);
+			s.depth = depth;
+			s.ready.store(true, std::memory_order_release);
+			h = hash;
+		}
+		if (h == hash) {
+			s.samples.fetch_add(1, std::memory_order_relaxed);
+			s.bytes.fetch_add(size, std::memory_order_relaxed);
+			return;
+		}
+	}
+#else
+	(void)size;
+#endif
+}
+
+void* tracked_alloc(std::size_t size) throw()
+{
+	char* p = static_cast<char*>(std::malloc(size + alloc_header));
+	if (!p)
+		return nullptr;
+	*reinterpret_cast<std::size_t*>(p) = size;
+
+	count_alloc(frame_counters, size);
+	count_alloc(total_counters, size);
+
+	if (!in_hook) {
+		in_hook = true;
+		if (current_zone)
+			count_zone(current_zone, size);
+		if (--sample_countdown == 0) {
+			sample_countdown = alloc_sample_period;
+			sample_stack(size);
+		}
+		in_hook = false;
+	}
+	return p + alloc_header;
+}
+
+void tracked_free(void* ptr) throw()
+{
+	if (!ptr)
+		return;
+	char* p = static_cast<char*>(ptr) - alloc_header;
+	const std::size_t size = *reinterpret_cast<std::size_t*>(p);
+
+	count_free(frame_counters, size);
+	count_free(total_counters, size);
+	std::free(p);
+}
+
+void* tracked_new(std::size_t size)
+{
+	for (;;) {
+		void* p = tracked_alloc(size? size: 1);
+		if (p)
+			return p;
+		std::new_handler handler = std::get_new_handler();
+		if (!handler)
+			throw std::bad_alloc();
+		handler();
+	}
+}
+
+} // anonymous
+
+bool alloc_tracking() throw()
+{
+	return true;
+}
+
+alloc_stats end_alloc_frame() throw()
+{
+	alloc_stats stats;
+	stats.allocs = frame_counters.allocs.exchange(0, std::memory_order_relaxed);
+	stats.frees = frame_counters.frees.exchange(0, std::memory_order_relaxed);
+	stats.bytes = frame_counters.bytes.exchange(0, std::memory_order_relaxed);
+	stats.peak_live = frame_counters.peak.exchange(
+		total_counters.live.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	return stats;
+}
+
+alloc_stats get_alloc_totals() throw()
+{
+	alloc_stats stats;
+	stats.allocs = total_counters.allocs.load(std::memory_order_relaxed);
+	stats.frees = total_counters.frees.load(std::memory_order_relaxed);
+	stats.bytes = total_counters.bytes.load(std::memory_order_relaxed);
+	stats.peak_live = total_counters.peak.load(std::memory_order_relaxed);
+	return stats;
+}
+
+const char* set_alloc_zone(const char* name) throw()
+{
+	const char* previous = current_zone;
+	current_zone = name;
+	return previous;
+}
+
+void write_alloc_report(std::ostream& ostr, size_type top_stacks)
+{
+	// The report itself allocates, which is not attributed.
+	const bool was_in_hook = in_hook;
+	in_hook = true;
+
+	const alloc_stats totals(get_alloc_totals());
+	ostr << boost::format("allocations: count=%1%, bytes=%2%, frees=%3%, peak_live=%4%\n")
+		% totals.allocs
+		% totals.bytes
+		% totals.frees
+		% totals.peak_live;
+
+	std::vector<const zone_slot*> by_zone;
+	for (size_type i = 0; i < zone_slots; ++i) {
+		if (zones[i].name.load(std::memory_order_acquire))
+			by_zone.push_back(&zones[i]);
+	}
+	std::sort(by_zone.begin(), by_zone.end(), [](const zone_slot* a, const zone_slot* b) {
+		return a->bytes.load() > b->bytes.load();
+	});
+	for (auto it = by_zone.begin(); it != by_zone.end(); ++it) {
+		ostr << boost::format("zone %1%: count=%2%, bytes=%3%\n")
+			% (*it)->name.load()
+			% (*it)->allocs.load()
+			% (*it)->bytes.load();
+	}
+
+	std::vector<const stack_slot*> by_stack;
+	for (size_type i = 0; i < stack_slots; ++i) {
+		if (stacks[i].ready.load(std::memory_order_acquire))
+			by_stack.push_back(&stacks[i]);
+	}
+	std::sort(by_stack.begin(), by_stack.end(), [](const stack_slot* a, const stack_slot* b) {
+		return a->samples.load() > b->samples.load();
+	});
+	if (by_stack.size() > top_stacks)
+		by_stack.resize(top_stacks);
+
+	for (auto it = by_stack.begin(); it != by_stack.end(); ++it) {
+		ostr << boost::format("stack: samples=%1%, sampled_bytes=%2%\n")
+			% (*it)->samples.load()
+			% (*it)->bytes.load();
+#ifdef PUP_NIX
+		// Skip the frames of the allocation hooks.
+		const int skip = std::min((*it)->depth, 3);
+		char** symbols = ::backtrace_symbols((*it)->frames + skip, (*it)->depth - skip);
+		for (int i = 0; symbols && i < (*it)->depth - skip; ++i)
+			ostr << "\t" << symbols[i] << "\n";
+		std::free(symbols);
+#endif
+	}
+
+	in_hook = was_in_hook;
+}
+
+#else
+
+bool alloc_tracking() throw()
+{
+	return false;
+}
+
+alloc_stats end_alloc_frame() throw()
+{
+	return alloc_stats();
+}
+
+alloc_stats get_alloc_totals() throw()
+{
+	return alloc_stats();
+}
+
+const char* set_alloc_zone(const char* name) throw()
+{
+	(void)name;
+	return nullptr;
+}
+
+void write_alloc_report(std::ostream& ostr, size_type top_stacks)
+{
+	(void)top_stacks;
+	ostr << "allocation tracking is compiled out (build with PUP_TRACK_ALLOC defined)\n";
+}
+
+#endif
+
+arena::arena(size_type capacity) :
+	cursor_(nullptr),
+	limit_(nullptr),
+	used_(0),
+	peak_(0),
+	capacity_(0)
+{
+	this->grow(std::max<size_type>(capacity, 1));
+}
+
+arena::~arena() throw()
+{
+	for (auto it = chunks_.begin(); it != chunks_.end(); ++it)
+		delete[] it->data;
+}
+
+void* arena::allocate(size_type size, size_type align)
+{
+	std::uintptr_t p = reinterpret_cast<std::uintptr_t>(cursor_);
+	std::uintptr_t aligned = (p + align - 1) & ~static_cast<std::uintptr_t>(align - 1);
+
+	if (aligned + size > reinterpret_cast<std::uintptr_t>(limit_)) {
+		this->grow(std::max(size + align, chunks_.back().size * 2));
+		p = reinterpret_cast<std::uintptr_t>(cursor_);
+		aligned = (p + align - 1) & ~static_cast<std::uintptr_t>(align - 1);
+	}
+
+	cursor_ = reinterpret_cast<char*>(aligned + size);
+	used_ += size + (aligned - p);
+	return reinterpret_cast<void*>(aligned);
+}
+
+void arena::deallocate(void* p, size_type size) throw()
+{
+	if (static_cast<char*>(p) + size == cursor_) {
+		cursor_ = static_cast<char*>(p);
+		used_ -= size;
+	}
+}
+
+void arena::reset() throw()
+{
+	peak_ = std::max(peak_, used_);
+	used_ = 0;
+
+	if (chunks_.size() > 1) {
+		try {
+			chunk merged = { new char[capacity_], capacity_ };
+			for (auto it = chunks_.begin(); it != chunks_.end(); ++it)
+				delete[] it->data;
+			chunks_.clear();
+			chunks_.push_back(merged);
+		}
+		catch (const std::bad_alloc&) {
+			// Keep the chunks, the next chunk is still used first.
+		}
+	}
+
+	cursor_ = chunks_.back().data;
+	limit_ = cursor_ + chunks_.back().size;
+}
+
+void arena::grow(size_type size)
+{
+	chunks_.reserve(chunks_.size() + 1);
+	chunk c = { new char[size], size };
+	chunks_.push_back(c);
+	cursor_ = c.data;
+	limit_ = c.data + size;
+	capacity_ += size;
+}
+
+arena& frame_arena()
+{
+	static thread_local arena a;
+	return a;
+}
+
+} // mem
+} // pup
+
+#ifdef PUP_TRACK_ALLOC
+
+void* operator new(std::size_t size)
+{
+	return pup::mem::tracked_new(size);
+}
+
+void* operator new[](std::size_t size)
+{
+	return pup::mem::tracked_new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) throw()
+{
+	try {
+		return pup::mem::tracked_new(size);
+	}
+	catch (...) {
+		return nullptr;
+	}
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) throw()
+{
+	try {
+		return pup::mem::tracked_new(size);
+	}
+	catch (...) {
+		return nullptr;
+	}
+}
+
+void operator delete(void* p) throw()
+{
+	pup::mem::tracked_free(p);
+}
+
+void operator delete[](void* p) throw()
+{
+	pup::mem::tracked_free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) throw()
+{
+	pup::mem::tracked_free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) throw()
+{
+	pup::mem::tracked_free(p);
+}
+
+void operator delete(void* p, std::size_t) throw()
+{
+	pup::mem::tracked_free(p);
+}
+
+void operator delete[](void* p, std::size_t) throw()
+{
+	pup::mem::tracked_free(p);
+}
+
+#endif
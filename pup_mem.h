@@ -0,0 +1,201 @@
+
+// libPowerUP - Create games with SDL2 and OpenGL
+// Copyright(c) 2015, Erik Edlund <erik.edlund@32767.se>
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with
+// or without modification, are permitted provided that the
+// following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above
+//    copyright notice, this list of conditions and the
+//    following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above
+//    copyright notice, this list of conditions and the
+//    following disclaimer in the documentation and / or
+//    other materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names
+//    of its contributors may be used to endorse or promote
+//    products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES(INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+
+#ifndef LIBPUP_PUP_MEM_H
+#define LIBPUP_PUP_MEM_H
+
+#include "pup_env.h"
+#include "pup_core.h"
+
+// Defining PUP_TRACK_ALLOC replaces the global operator new and
+// delete with versions that count every allocation, see
+// %pup::mem::end_alloc_frame() and %pup::mem::write_alloc_report().
+// Each allocation then costs a few atomic operations and a header
+// of %alloc_header bytes, so it is meant for instrumented builds.
+
+namespace pup {
+namespace mem {
+
+// A bump allocator. Memory is handed out from large chunks and
+// only reclaimed all at once by %reset(), which also merges the
+// chunks so that a workload of steady size stops allocating
+// after its first few rounds. Not thread-safe.
+class arena :
+	private boost::noncopyable
+{
+public:
+	explicit arena(size_type capacity = 64 * 1024);
+	~arena() throw();
+
+	void* allocate(size_type size, size_type align = alignof(std::max_align_t));
+
+	// Only the most recent allocation is actually given back.
+	void deallocate(void* p, size_type size) throw();
+
+	// Invalidates everything allocated from the arena.
+	void reset() throw();
+
+	size_type get_used() const throw() { return used_; }
+	size_type get_peak() const throw() { return std::max(peak_, used_); }
+	size_type get_capacity() const throw() { return capacity_; }
+
+private:
+	struct chunk
+	{
+		char* data;
+		size_type size;
+	};
+
+	void grow(size_type size);
+
+	std::vector<chunk> chunks_;
+	char* cursor_;
+	char* limit_;
+	size_type used_;
+	size_type peak_;
+	size_type capacity_;
+};
+
+// The arena of the calling thread for memory that lives until the
+// end of the current frame. The application resets the arena of
+// the main thread at the end of %application::after_render() and
+// that of the simulation thread after every simulation step.
+arena& frame_arena();
+
+// Standard allocator adaptor for %arena, defaulting to the frame
+// arena of the calling thread.
+template <typename T>
+class arena_allocator
+{
+public:
+	typedef T value_type;
+
+	arena_allocator() throw() :
+		arena_(&frame_arena())
+	{}
+
+	explicit arena_allocator(arena& a) throw() :
+		arena_(&a)
+	{}
+
+	template <typename U>
+	arena_allocator(const arena_allocator<U>& other) throw() :
+		arena_(other.get_arena())
+	{}
+
+	inline T* allocate(std::size_t n)
+	{
+		return static_cast<T*>(arena_->allocate(n * sizeof(T), alignof(T)));
+	}
+
+	inline void deallocate(T* p, std::size_t n) throw()
+	{
+		arena_->deallocate(p, n * sizeof(T));
+	}
+
+	inline arena* get_arena() const throw() { return arena_; }
+
+private:
+	arena* arena_;
+};
+
+template <typename T, typename U>
+inline bool operator==(const arena_allocator<T>& a, const arena_allocator<U>& b) throw()
+{
+	return a.get_arena() == b.get_arena();
+}
+
+template <typename T, typename U>
+inline bool operator!=(const arena_allocator<T>& a, const arena_allocator<U>& b) throw()
+{
+	return !(a == b);
+}
+
+// Containers allocated from the frame arena, which must not be
+// kept beyond the end of the frame.
+typedef std::basic_string<char, std::char_traits<char>, arena_allocator<char>> frame_string;
+
+template <typename T>
+using frame_vector = std::vector<T, arena_allocator<T>>;
+
+// Heap allocations made through operator new, by all threads.
+struct alloc_stats
+{
+	alloc_stats() :
+		allocs(0),
+		frees(0),
+		bytes(0),
+		peak_live(0)
+	{}
+
+	size_type allocs;
+	size_type frees;
+	size_type bytes;
+	size_type peak_live; // the most bytes allocated at once
+};
+
+const size_type alloc_header = alignof(std::max_align_t);
+
+// Every %alloc_sample_period:th allocation of each thread has its
+// call stack sampled.
+const size_type alloc_sample_period = 256;
+
+// Whether the library was built with PUP_TRACK_ALLOC.
+bool alloc_tracking() throw();
+
+// The allocations since the previous call, which starts the next
+// frame. Called by the application at the end of every frame.
+alloc_stats end_alloc_frame() throw();
+
+// The allocations since the start of the program.
+alloc_stats get_alloc_totals() throw();
+
+// Attribute the allocations of the calling thread to the named
+// zone until the previous zone, which is returned, is restored.
+// Profiling zones do this when PUP_TRACE is also defined. The
+// name must outlive the program, e.g. be a string literal.
+const char* set_alloc_zone(const char* name) throw();
+
+// Write the totals, the allocations per zone and the call stacks
+// sampled most often.
+void write_alloc_report(std::ostream& ostr, size_type top_stacks = 10);
+
+} // mem
+} // pup
+
+#endif
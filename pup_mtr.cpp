@@ -0,0 +1,405 @@
+
+// libPowerUP - Create games with SDL2 and OpenGL
+// Copyright(c) 2015, Erik Edlund <erik.edlund@32767.se>
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with
+// or without modification, are permitted provided that the
+// following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above
+//    copyright notice, this list of conditions and the
+//    following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above
+//    copyright notice, this list of conditions and the
+//    following disclaimer in the documentation and / or
+//    other materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names
+//    of its contributors may be used to endorse or promote
+//    products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES(INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+
+#include "pup_mtr.h"
+#include "pup_log.h"
+
+namespace pup {
+namespace mtr {
+
+namespace {
+
+typedef std::shared_ptr<const std::string> line_ptr;
+
+class client
+{
+public:
+	virtual ~client() throw() {}
+
+	virtual void send(const line_ptr& line) = 0;
+	virtual void close() throw() = 0;
+	virtual bool is_open() const throw() = 0;
+};
+
+typedef std::shared_ptr<client> client_ptr;
+
+} // anonymous
+
+// Apart from the ring of samples, everything is only touched by
+// the thread running the io_service.
+struct server::state :
+	public std::enable_shared_from_this<server::state>
+{
+	state(boost::asio::io_service& i, ::Sint64 n, size_type b) :
+		io(i),
+		timer(i),
+		interval(n),
+		backlog(std::max<size_type>(b, 1)),
+		samples(sample_capacity),
+		head(0),
+		count(0),
+		spare(sample_capacity),
+		last_end(0),
+		clients_open(0),
+		dropped(0),
+		closed(false)
+	{
+		taken.reserve(sample_capacity);
+	}
+
+	template <class Protocol>
+	void accept(typename Protocol::acceptor& acceptor);
+
+	void schedule();
+	void publish();
+	void serialize(std::ostream& ostr);
+	void close() throw();
+
+	boost::asio::io_service& io;
+	boost::asio::steady_timer timer;
+	std::unique_ptr<boost::asio::ip::tcp::acceptor> tcp_acceptor;
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+	std::unique_ptr<boost::asio::local::stream_protocol::acceptor> local_acceptor;
+	std::string local_path;
+#endif
+	::Sint64 interval;
+	size_type backlog;
+
+	std::mutex mutex; // guards samples, head and count
+	std::vector<sample> samples;
+	size_type head;
+	size_type count;
+
+	// Swapped with %samples when publishing, so the lock is never
+	// held while copying samples.
+	std::vector<sample> spare;
+	std::vector<sample> taken;
+	::Sint64 last_end;
+	std::vector<client_ptr> clients;
+	std::atomic<size_type> clients_open;
+	std::atomic<::Uint64> dropped;
+	bool closed;
+};
+
+namespace {
+
+template <class Socket>
+class session :
+	public client,
+	public std::enable_shared_from_this<session<Socket>>
+{
+public:
+	session(const std::shared_ptr<server::state>& st) :
+		socket(st->io),
+		state_(st),
+		writing_(false)
+	{}
+
+	// Drops the oldest line not being written when the queue is full.
+	virtual void send(const line_ptr& line)
+	{
+		if (queue_.size() >= state_->backlog) {
+			state_->dropped++;
+			if (writing_ && queue_.size() == 1)
+				return;
+			queue_.erase(queue_.begin() + (writing_? 1: 0));
+		}
+		queue_.push_back(line);
+		if (!writing_)
+			this->write();
+	}
+
+	virtual void close() throw()
+	{
+		boost::system::error_code ec;
+		socket.close(ec);
+	}
+
+	virtual bool is_open() const throw() { return socket.is_open(); }
+
+	Socket socket;
+
+private:
+	void write()
+	{
+		std::shared_ptr<session> self(this->shared_from_this());
+
+		writing_ = true;
+		boost::asio::async_write(socket, boost::asio::buffer(*queue_.front()),
+			[this, self](const boost::system::error_code& ec, std::size_t) {
+				writing_ = false;
+				if (ec) {
+					this->close();
+					return;
+				}
+				queue_.pop_front();
+				if (!queue_.empty())
+					this->write();
+			});
+	}
+
+	std::shared_ptr<server::state> state_;
+	std::deque<line_ptr> queue_;
+	bool writing_;
+};
+
+} // anonymous
+
+template <class Protocol>
+void server::state::accept(typename Protocol::acceptor& acceptor)
+{
+	typedef session<typename Protocol::socket> session_type;
+
+	std::shared_ptr<state> self(this->shared_from_this());
+	std::shared_ptr<session_type> s(new session_type(self));
+
+	acceptor.async_accept(s->socket, [this, self, s, &acceptor](const boost::system::error_code& ec) {
+		if (closed || ec == boost::asio::error::operation_aborted)
+			return;
+		if (ec) {
+			PUP_LOG(warning) << boost::format("metrics: accept failed: %1%")
+				% ec.message();
+		} else {
+			clients.push_back(s);
+			clients_open = clients.size();
+		}
+		this->accept<Protocol>(acceptor);
+	});
+}
+
+void server::state::schedule()
+{
+	std::shared_ptr<state> self(this->shared_from_this());
+
+	timer.expires_from_now(std::chrono::nanoseconds(interval));
+	timer.async_wait([this, self](const boost::system::error_code& ec) {
+		if (ec || closed)
+			return;
+		this->publish();
+		this->schedule();
+	});
+}
+
+void server::state::publish()
+{
+	size_type first;
+	size_type n;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		samples.swap(spare);
+		first = (head + sample_capacity - count) % sample_capacity;
+		n = count;
+		head = 0;
+		count = 0;
+	}
+
+	taken.clear();
+	for (size_type i = 0; i < n; ++i)
+		taken.push_back(std::move(spare[(first + i) % sample_capacity]));
+
+	clients.erase(std::remove_if(clients.begin(), clients.end(), [](const client_ptr& c) {
+		return !c->is_open();
+	}), clients.end());
+	clients_open = clients.size();
+
+	if (taken.empty())
+		return;
+
+	if (!clients.empty()) {
+		std::ostringstream ostr;
+		this->serialize(ostr);
+		const line_ptr line(new std::string(ostr.str()));
+
+		for (auto it = clients.begin(); it != clients.end(); ++it)
+			(*it)->send(line);
+	}
+	last_end = taken.back().frame.end;
+}
+
+// One object per line, times in milliseconds. Phase times are
+// means over the frames of the interval.
+void server::state::serialize(std::ostream& ostr)
+{
+	const sample& last(taken.back());
+	const double frames = static_cast<double>(taken.size());
+	const ::Sint64 span = last_end? last.frame.end - last_end: interval;
+
+	::Sint64 frame_max = 0;
+	::Sint64 input_max = 0;
+	size_type events = 0;
+	size_type allocs = 0;
+	size_type alloc_bytes = 0;
+	size_type peak_live = 0;
+	size_type arena_peak = 0;
+	std::array<double, prf::PHASE_COUNT> phases;
+	phases.fill(0.0);
+
+	for (auto it = taken.begin(); it != taken.end(); ++it) {
+		for (int p = 0; p < prf::PHASE_COUNT; ++p)
+			phases[p] += it->frame.phases[p] / 1e6;
+		frame_max = std::max(frame_max, it->frame.phases[prf::PHASE_FRAME]);
+		input_max = std::max(input_max, it->frame.input_latency);
+		events += it->frame.events_delivered;
+		allocs += it->frame.allocs;
+		alloc_bytes += it->frame.alloc_bytes;
+		peak_live = std::max(peak_live, it->peak_live);
+		arena_peak = std::max(arena_peak, it->arena_peak);
+	}
+
+	ostr << boost::format("{\"time_ms\":%1$.1f,\"frames\":%2%,\"fps\":%3$.1f,"
+		"\"rendered\":%4%,\"missed\":%5%,\"frame_max_ms\":%6$.3f,\"phases_ms\":{")
+		% (last.frame.end / 1e6)
+		% taken.size()
+		% (span > 0? frames * 1e9 / span: 0.0)
+		% last.rendered
+		% last.missed
+		% (frame_max / 1e6);
+	for (int p = 0; p < prf::PHASE_COUNT; ++p) {
+		ostr << boost::format("%1%\"%2%\":%3$.3f")
+			% (p? ",": "")
+			% prf::phase_name(static_cast<prf::phase>(p))
+			% (phases[p] / frames);
+	}
+	ostr << boost::format("},\"events\":%1%,\"allocs\":%2%,\"alloc_bytes\":%3%,"
+		"\"peak_live\":%4%,\"arena_peak\":%5%,\"gpu_ms\":%6$.3f,\"resolution_scale\":%7$.3f,"
+		"\"input_latency_max_ms\":%8$.3f,\"music\":{\"playing\":%9%,\"volume\":%10%},"
+		"\"dropped\":%11%,\"controller\":")
+		% events
+		% allocs
+		% alloc_bytes
+		% peak_live
+		% arena_peak
+		% (last.frame.gpu_ns / 1e6)
+		% last.frame.resolution_scale
+		% (input_max / 1e6)
+		% (last.music_playing? "true": "false")
+		% last.music_volume
+		% dropped.load();
+	prf::write_json_string(ostr, last.frame.controller);
+	ostr << "}\n";
+}
+
+void server::state::close() throw()
+{
+	boost::system::error_code ec;
+
+	closed = true;
+	timer.cancel(ec);
+	if (tcp_acceptor)
+		tcp_acceptor->close(ec);
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+	if (local_acceptor) {
+		local_acceptor->close(ec);
+		boost::filesystem::remove(local_path, ec);
+	}
+#endif
+	for (auto it = clients.begin(); it != clients.end(); ++it)
+		(*it)->close();
+	clients.clear();
+	clients_open = 0;
+}
+
+server::server(boost::asio::io_service& io, const std::string& endpoint,
+	::Sint64 interval, size_type backlog) :
+	state_(new state(io, std::max<::Sint64>(interval, 1000000), backlog))
+{
+	std::shared_ptr<state> st(state_);
+
+	if (boost::starts_with(endpoint, "tcp:")) {
+		const unsigned short port = boost::lexical_cast<unsigned short>(endpoint.substr(4));
+		st->tcp_acceptor.reset(new boost::asio::ip::tcp::acceptor(io,
+			boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::loopback(), port)));
+		io.post([st]() { st->accept<boost::asio::ip::tcp>(*st->tcp_acceptor); });
+	}
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+	else if (boost::starts_with(endpoint, "unix:")) {
+		st->local_path = endpoint.substr(5);
+
+		// Only a socket left behind by an earlier run is replaced.
+		const boost::filesystem::file_type type =
+			boost::filesystem::symlink_status(st->local_path).type();
+		if (type == boost::filesystem::socket_file) {
+			boost::filesystem::remove(st->local_path);
+		} else if (type != boost::filesystem::file_not_found) {
+			PUP_ERR(std::runtime_error, boost::str(boost::format(
+				"metrics path \"%1%\" exists and is not a socket") % st->local_path));
+		}
+		st->local_acceptor.reset(new boost::asio::local::stream_protocol::acceptor(io,
+			boost::asio::local::stream_protocol::endpoint(st->local_path)));
+		io.post([st]() {
+			st->accept<boost::asio::local::stream_protocol>(*st->local_acceptor);
+		});
+	}
+#endif
+	else {
+		PUP_ERR(std::runtime_error, boost::str(boost::format(
+			"invalid metrics endpoint \"%1%\"") % endpoint));
+	}
+
+	io.post([st]() { st->schedule(); });
+}
+
+// The io_service must no longer be run, the handlers still queued
+// only keep the closed state alive.
+server::~server() throw()
+{
+	state_->close();
+}
+
+void server::push(const sample& s) throw()
+{
+	state& st(*state_);
+	std::lock_guard<std::mutex> lock(st.mutex);
+
+	st.samples[st.head] = s;
+	st.head = (st.head + 1) % sample_capacity;
+	st.count = std::min(st.count + 1, sample_capacity);
+}
+
+size_type server::get_clients() const throw()
+{
+	return state_->clients_open.load();
+}
+
+::Uint64 server::get_dropped() const throw()
+{
+	return state_->dropped.load();
+}
+
+} // mtr
+} // pup
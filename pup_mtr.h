@@ -0,0 +1,107 @@
+
+// libPowerUP - Create games with SDL2 and OpenGL
+// Copyright(c) 2015, Erik Edlund <erik.edlund@32767.se>
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with
+// or without modification, are permitted provided that the
+// following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above
+//    copyright notice, this list of conditions and the
+//    following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above
+//    copyright notice, this list of conditions and the
+//    following disclaimer in the documentation and / or
+//    other materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names
+//    of its contributors may be used to endorse or promote
+//    products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES(INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+
+#ifndef LIBPUP_PUP_MTR_H
+#define LIBPUP_PUP_MTR_H
+
+#include "pup_env.h"
+#include "pup_core.h"
+#include "pup_prf.h"
+
+namespace pup {
+namespace mtr {
+
+// The state of the application after a frame.
+struct sample
+{
+	sample() :
+		missed(0),
+		rendered(0),
+		peak_live(0),
+		arena_peak(0),
+		music_playing(false),
+		music_volume(0)
+	{}
+
+	prf::flight_frame frame;
+	::Uint32 missed;
+	::Uint32 rendered;
+	size_type peak_live;
+	size_type arena_peak;
+	bool music_playing;
+	int music_volume;
+};
+
+// The samples kept per interval.
+const size_type sample_capacity = 1024;
+
+// Streams the samples pushed by the main thread as one line of
+// JSON per interval to every connected client. The samples of an
+// interval are summarized and serialized once by the thread
+// running the io_service, which must not be the main thread.
+// Every client has a queue of at most %backlog lines. A client
+// too slow to keep up loses its oldest lines, it never holds up
+// the other clients nor the main thread.
+class server :
+	private boost::noncopyable
+{
+public:
+	struct state;
+
+	// The endpoint is "tcp:<port>", listening on 127.0.0.1, or
+	// "unix:<path>" where available. An existing socket at the path
+	// is replaced, any other file is an error.
+	server(boost::asio::io_service& io, const std::string& endpoint,
+		::Sint64 interval, size_type backlog = 64);
+	~server() throw();
+
+	// Never blocks on io, once the ring of samples of an interval
+	// is full the oldest sample is replaced.
+	void push(const sample& s) throw();
+
+	size_type get_clients() const throw();
+	::Uint64 get_dropped() const throw();
+
+private:
+	std::shared_ptr<state> state_;
+};
+
+} // mtr
+} // pup
+
+#endif
@@ -0,0 +1,670 @@
+
+// libPowerUP - Create games with SDL2 and OpenGL
+// Copyright(c) 2015, Erik Edlund <erik.edlund@32767.se>
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with
+// or without modification, are permitted provided that the
+// following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above
+//    copyright notice, this list of conditions and the
+//    following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above
+//    copyright notice, this list of conditions and the
+//    following disclaimer in the documentation and / or
+//    other materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names
+//    of its contributors may be used to endorse or promote
+//    products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES(INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+
+#include "pup_prf.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace pup {
+namespace prf {
+
+namespace {
+
+struct zone
+{
+	std::atomic<const char*> name;
+	std::atomic<::Sint64> start;
+	std::atomic<::Sint64> end;
+};
+
+// Written only by its owning thread. Readers copy the zones and
+// discard any that may have been overwritten while copying. Zones
+// before %first belong to a thread that has exited.
+struct zone_buffer
+{
+	zone_buffer(int t) :
+		zones(new zone[zone_capacity]),
+		written(0),
+		first(0),
+		name(nullptr),
+		tid(t),
+		in_use(true)
+	{}
+
+	std::unique_ptr<zone[]> zones;
+	std::atomic<::Uint64> written;
+	std::atomic<::Uint64> first;
+	std::atomic<const char*> name;
+	std::atomic<int> tid;
+	std::atomic<bool> in_use;
+};
+
+typedef std::shared_ptr<zone_buffer> zone_buffer_ptr;
+
+struct zone_registry
+{
+	zone_registry() :
+		next_tid(0)
+	{}
+
+	std::mutex mutex;
+	std::vector<zone_buffer_ptr> buffers;
+	int next_tid;
+};
+
+zone_registry& registry()
+{
+	static zone_registry r;
+	return r;
+}
+
+// Hands the buffer back when its thread exits.
+struct buffer_owner
+{
+	buffer_owner() :
+		buffer(nullptr)
+	{}
+
+	~buffer_owner()
+	{
+		if (buffer)
+			buffer->in_use = false;
+	}
+
+	zone_buffer* buffer;
+};
+
+zone_buffer* local_buffer() throw()
+{
+	thread_local buffer_owner owner;
+
+	if (!owner.buffer) {
+		try {
+			zone_registry& r(registry());
+			std::lock_guard<std::mutex> lock(r.mutex);
+			const int tid = ++r.next_tid;
+			for (auto it = r.buffers.begin(); it != r.buffers.end(); ++it) {
+				if (!(*it)->in_use) {
+					zone_buffer& buffer(**it);
+					buffer.in_use = true;
+					buffer.name = nullptr;
+					buffer.tid = tid;
+					buffer.first = buffer.written.load();
+					owner.buffer = &buffer;
+					return owner.buffer;
+				}
+			}
+			r.buffers.push_back(zone_buffer_ptr(new zone_buffer(tid)));
+			owner.buffer = r.buffers.back().get();
+		}
+		catch (...) {
+			return nullptr;
+		}
+	}
+	return owner.buffer;
+}
+
+// Nearest-rank percentiles of the first %n values, which are
+// reordered. Each percentile selected must not be lower than the
+// one before, so that every selection only partitions the values
+// above the previous rank.
+class percentiles
+{
+public:
+	percentiles(std::vector<::Sint64>& values, size_type n) :
+		first_(values.begin()),
+		last_(values.begin() + n),
+		from_(values.begin()),
+		n_(n)
+	{
+	}
+
+	::Sint64 select(double q)
+	{
+		const size_type r = static_cast<size_type>(std::ceil(q * n_));
+		auto it = first_ + (r? r - 1: 0);
+		std::nth_element(from_, it, last_);
+		from_ = it;
+		return *it;
+	}
+
+	::Sint64 max() const { return *std::max_element(from_, last_); }
+
+private:
+	std::vector<::Sint64>::iterator first_;
+	std::vector<::Sint64>::iterator last_;
+	std::vector<::Sint64>::iterator from_;
+	size_type n_;
+};
+
+} // anonymous
+
+void write_json_string(std::ostream& ostr, const char* str)
+{
+	ostr << '"';
+	for (; *str; ++str) {
+		if (*str == '"' || *str == '\\')
+			ostr << '\\';
+		if (static_cast<unsigned char>(*str) >= 0x20)
+			ostr << *str;
+	}
+	ostr << '"';
+}
+
+const char* phase_name(phase p) throw()
+{
+	switch (p) {
+	case PHASE_REACT: return "react";
+	case PHASE_THINK: return "think";
+	case PHASE_BEFORE_RENDER: return "before_render";
+	case PHASE_RENDER: return "render";
+	case PHASE_AFTER_RENDER: return "after_render";
+	case PHASE_MISC: return "misc";
+	case PHASE_FRAME: return "frame";
+	default: return "unknown";
+	}
+}
+
+const char* counter_name(counter c) throw()
+{
+	switch (c) {
+	case COUNTER_CYCLES: return "cycles";
+	case COUNTER_INSTRUCTIONS: return "instructions";
+	case COUNTER_CACHE_MISSES: return "cache_misses";
+	case COUNTER_BRANCH_MISSES: return "branch_misses";
+	default: return "unknown";
+	}
+}
+
+hw_counters::hw_counters() :
+	group_(-1),
+	open_(0)
+{
+	fds_.fill(-1);
+	slots_.fill(-1);
+
+#ifdef __linux__
+	static const ::Uint64 configs[COUNTER_COUNT] = {
+		PERF_COUNT_HW_CPU_CYCLES,
+		PERF_COUNT_HW_INSTRUCTIONS,
+		PERF_COUNT_HW_CACHE_MISSES,
+		PERF_COUNT_HW_BRANCH_MISSES
+	};
+
+	// Cycles lead the group, without them there is nothing to
+	// relate the other counts to.
+	for (int c = 0; c < COUNTER_COUNT; ++c) {
+		::perf_event_attr attr;
+		std::memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.config = configs[c];
+		attr.disabled = c == COUNTER_CYCLES;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_GROUP;
+
+		const int fd = static_cast<int>(::syscall(SYS_perf_event_open,
+			&attr, 0, -1, group_, 0));
+		if (fd < 0) {
+			if (c == COUNTER_CYCLES) {
+				error_ = boost::str(boost::format("perf_event_open: %1%")
+					% std::strerror(errno));
+				return;
+			}
+			continue;
+		}
+		if (c == COUNTER_CYCLES)
+			group_ = fd;
+		fds_[c] = fd;
+		slots_[c] = open_++;
+	}
+
+	::ioctl(group_, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	::ioctl(group_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#else
+	error_ = "hardware counters are only implemented on Linux";
+#endif
+}
+
+hw_counters::~hw_counters() throw()
+{
+#ifdef __linux__
+	for (int c = COUNTER_COUNT - 1; c >= 0; --c) {
+		if (fds_[c] >= 0)
+			::close(fds_[c]);
+	}
+#endif
+}
+
+void hw_counters::read(counter_values& values) const throw()
+{
+	values.fill(0);
+
+#ifdef __linux__
+	if (group_ < 0)
+		return;
+
+	::Uint64 buffer[1 + COUNTER_COUNT];
+	if (::read(group_, buffer, sizeof(buffer)) < static_cast<::ssize_t>(sizeof(::Uint64)))
+		return;
+
+	for (int c = 0; c < COUNTER_COUNT; ++c) {
+		if (slots_[c] >= 0 && static_cast<::Uint64>(slots_[c]) < buffer[0])
+			values[c] = buffer[1 + slots_[c]];
+	}
+#endif
+}
+
+hw_counters& hw_counters::local()
+{
+	thread_local hw_counters counters;
+	return counters;
+}
+
+frame_profiler::frame_profiler(size_type window) :
+	head_(0),
+	count_(0),
+	counters_(nullptr)
+{
+	this->set_window(window);
+	current_.fill(0);
+	start_.fill(0);
+	for (int p = 0; p < PHASE_COUNT; ++p) {
+		current_counters_[p].fill(0);
+		start_counters_[p].fill(0);
+	}
+}
+
+void frame_profiler::begin_frame() throw()
+{
+	current_.fill(0);
+	for (int p = 0; p < PHASE_COUNT; ++p)
+		current_counters_[p].fill(0);
+	this->begin(PHASE_FRAME);
+}
+
+void frame_profiler::end_frame() throw()
+{
+	this->end(PHASE_FRAME);
+
+	if (counters_)
+		counter_frames_[head_] = current_counters_;
+	frames_[head_] = current_;
+	head_ = (head_ + 1) % frames_.size();
+	count_ = std::min(count_ + 1, frames_.size());
+}
+
+phase_stats frame_profiler::get_stats(phase p) const
+{
+	phase_stats stats;
+
+	if (!count_)
+		return stats;
+
+	::Sint64 sum = 0;
+	for (size_type i = 0; i < count_; ++i) {
+		scratch_[i] = frames_[i][p];
+		sum += scratch_[i];
+	}
+	stats.mean = sum / static_cast<::Sint64>(count_);
+
+	percentiles ranks(scratch_, count_);
+	stats.p50 = ranks.select(0.50);
+	stats.p95 = ranks.select(0.95);
+	stats.p99 = ranks.select(0.99);
+	stats.max = ranks.max();
+
+	return stats;
+}
+
+::Sint64 frame_profiler::get_last(phase p) const throw()
+{
+	return count_? frames_[(head_ + frames_.size() - 1) % frames_.size()][p]: 0;
+}
+
+void frame_profiler::set_window(size_type window)
+{
+	window = std::max<size_type>(window, 1);
+	frames_.assign(window, frame_record());
+	scratch_.assign(window, 0);
+	if (counters_)
+		counter_frames_.assign(window, counter_record());
+	head_ = 0;
+	count_ = 0;
+}
+
+bool frame_profiler::set_counters(bool enabled)
+{
+	hw_counters* counters = enabled? &hw_counters::local(): nullptr;
+	if (counters && !counters->available())
+		counters = nullptr;
+
+	if (counters != counters_) {
+		counters_ = counters;
+		this->set_window(frames_.size());
+		if (!counters_)
+			counter_frames_.clear();
+	}
+	return counters_ || !enabled;
+}
+
+counter_stats frame_profiler::get_counter_stats(phase p) const throw()
+{
+	counter_stats stats;
+
+	if (!counters_ || !count_)
+		return stats;
+
+	for (size_type i = 0; i < count_; ++i) {
+		for (int c = 0; c < COUNTER_COUNT; ++c)
+			stats.per_frame[c] += counter_frames_[i][p][c];
+	}
+	for (int c = 0; c < COUNTER_COUNT; ++c)
+		stats.per_frame[c] /= count_;
+
+	if (stats.per_frame[COUNTER_CYCLES] > 0.0)
+		stats.ipc = stats.per_frame[COUNTER_INSTRUCTIONS] / stats.per_frame[COUNTER_CYCLES];
+	return stats;
+}
+
+// One row per phase with percentiles in microseconds and, with
+// counters enabled, the mean counts per frame.
+void frame_profiler::write_csv(const boost::filesystem::path& path) const
+{
+	std::ofstream ostr(path.string());
+	if (!ostr)
+		PUP_ERR(std::runtime_error, boost::str(boost::format(
+			"failed to open \"%1%\"") % path.string()));
+
+	ostr << "phase,frames,p50_us,p95_us,p99_us,max_us";
+	if (counters_) {
+		for (int c = 0; c < COUNTER_COUNT; ++c)
+			ostr << ',' << counter_name(static_cast<counter>(c));
+		ostr << ",ipc";
+	}
+	ostr << '\n';
+
+	for (int p = 0; p < PHASE_COUNT; ++p) {
+		const phase_stats stats(this->get_stats(static_cast<phase>(p)));
+		ostr << boost::format("%1%,%2%,%3$.1f,%4$.1f,%5$.1f,%6$.1f")
+			% phase_name(static_cast<phase>(p))
+			% count_
+			% (stats.p50 / 1000.0)
+			% (stats.p95 / 1000.0)
+			% (stats.p99 / 1000.0)
+			% (stats.max / 1000.0);
+		if (counters_) {
+			const counter_stats counts(this->get_counter_stats(static_cast<phase>(p)));
+			for (int c = 0; c < COUNTER_COUNT; ++c)
+				ostr << boost::format(",%1$.0f") % counts.per_frame[c];
+			ostr << boost::format(",%1$.3f") % counts.ipc;
+		}
+		ostr << '\n';
+	}
+}
+
+flight_recorder::flight_recorder(size_type frames) :
+	head_(0),
+	count_(0),
+	budget_(0),
+	cooldown_(10000000000ll),
+	last_dump_(0),
+	recorded_(0),
+	spikes_(0)
+{
+	this->set_frames(frames);
+}
+
+bool flight_recorder::record(const flight_frame& frame, bool may_spike) throw()
+{
+	frames_[head_] = frame;
+	frames_[head_].index = recorded_++;
+	head_ = (head_ + 1) % frames_.size();
+	count_ = std::min(count_ + 1, frames_.size());
+
+	if (!may_spike || !budget_ || frame.phases[PHASE_FRAME] <= budget_)
+		return false;
+
+	spikes_++;
+	if (last_dump_ && frame.end - last_dump_ < cooldown_)
+		return false;
+	last_dump_ = frame.end;
+	return true;
+}
+
+void flight_recorder::snapshot(frame_vector& frames) const
+{
+	frames.clear();
+	frames.reserve(count_);
+	for (size_type i = 0; i < count_; ++i)
+		frames.push_back(frames_[(head_ + frames_.size() - count_ + i) % frames_.size()]);
+}
+
+void flight_recorder::set_frames(size_type frames)
+{
+	frames_.assign(std::max<size_type>(frames, 1), flight_frame());
+	head_ = 0;
+	count_ = 0;
+}
+
+// Times in microseconds, like the trace events.
+void flight_recorder::write_json(const boost::filesystem::path& path,
+	const frame_vector& frames, ::Sint64 budget)
+{
+	std::ofstream ostr(path.string());
+	if (!ostr)
+		PUP_ERR(std::runtime_error, boost::str(boost::format(
+			"failed to open \"%1%\"") % path.string()));
+
+	ostr << boost::format("{\"budget_us\":%1$.1f,\"frames\":[") % (budget / 1000.0);
+	for (auto it = frames.begin(); it != frames.end(); ++it) {
+		ostr << (it == frames.begin()? "": ",") << boost::format("\n{\"index\":%1%,\"end_us\":%2$.1f")
+			% it->index
+			% (it->end / 1000.0);
+		for (int p = 0; p < PHASE_COUNT; ++p) {
+			ostr << boost::format(",\"%1%_us\":%2$.1f")
+				% phase_name(static_cast<phase>(p))
+				% (it->phases[p] / 1000.0);
+		}
+		ostr << boost::format(",\"events_received\":%1%,\"events_delivered\":%2%"
+			",\"allocs\":%3%,\"alloc_bytes\":%4%,\"gpu_us\":%5$.1f,\"resolution_scale\":%6$.3f"
+			",\"input_latency_us\":%7$.1f,\"controller\":")
+			% it->events_received
+			% it->events_delivered
+			% it->allocs
+			% it->alloc_bytes
+			% (it->gpu_ns / 1000.0)
+			% it->resolution_scale
+			% (it->input_latency / 1000.0);
+		write_json_string(ostr, it->controller);
+		ostr << "}";
+	}
+	ostr << "]}\n";
+}
+
+latency_window::latency_window(size_type window) :
+	head_(0),
+	count_(0),
+	total_(0)
+{
+	this->set_window(window);
+}
+
+void latency_window::add(::Sint64 ns) throw()
+{
+	samples_[head_] = ns;
+	head_ = (head_ + 1) % samples_.size();
+	count_ = std::min(count_ + 1, samples_.size());
+	total_++;
+}
+
+latency_stats latency_window::get_stats() const
+{
+	latency_stats stats;
+
+	if (!count_)
+		return stats;
+
+	::Sint64 sum = 0;
+	for (size_type i = 0; i < count_; ++i) {
+		scratch_[i] = samples_[i];
+		sum += scratch_[i];
+	}
+	stats.count = count_;
+	stats.mean = sum / static_cast<::Sint64>(count_);
+	stats.min = *std::min_element(scratch_.begin(), scratch_.begin() + count_);
+
+	percentiles ranks(scratch_, count_);
+	stats.p50 = ranks.select(0.50);
+	stats.p99 = ranks.select(0.99);
+	stats.max = ranks.max();
+
+	return stats;
+}
+
+void latency_window::set_window(size_type window)
+{
+	window = std::max<size_type>(window, 1);
+	samples_.assign(window, 0);
+	scratch_.assign(window, 0);
+	head_ = 0;
+	count_ = 0;
+}
+
+void record_zone(const char* name, ::Sint64 start, ::Sint64 end) throw()
+{
+	zone_buffer* buffer = local_buffer();
+	if (!buffer)
+		return;
+
+	const ::Uint64 i = buffer->written.load(std::memory_order_relaxed);
+	zone& z(buffer->zones[i % zone_capacity]);
+	z.name.store(name, std::memory_order_relaxed);
+	z.start.store(start, std::memory_order_relaxed);
+	z.end.store(end, std::memory_order_relaxed);
+	buffer->written.store(i + 1, std::memory_order_release);
+}
+
+void set_thread_name(const char* name) throw()
+{
+	zone_buffer* buffer = local_buffer();
+	if (buffer)
+		buffer->name = name;
+}
+
+void write_trace(const boost::filesystem::path& path)
+{
+	struct copied_zone
+	{
+		const char* name;
+		::Sint64 start;
+		::Sint64 end;
+	};
+
+	std::ofstream ostr(path.string());
+	if (!ostr)
+		PUP_ERR(std::runtime_error, boost::str(boost::format(
+			"failed to open \"%1%\"") % path.string()));
+
+	std::vector<zone_buffer_ptr> buffers;
+	{
+		zone_registry& r(registry());
+		std::lock_guard<std::mutex> lock(r.mutex);
+		buffers = r.buffers;
+	}
+
+	bool first = true;
+	std::vector<copied_zone> zones;
+	zones.reserve(zone_capacity);
+
+	ostr << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+	for (auto it = buffers.begin(); it != buffers.end(); ++it) {
+		zone_buffer& buffer(**it);
+
+		const ::Uint64 before = buffer.written.load(std::memory_order_acquire);
+		const ::Uint64 begin = std::max<::Uint64>(buffer.first.load(),
+			before > zone_capacity? before - zone_capacity: 0);
+
+		zones.clear();
+		for (::Uint64 i = begin; i < before; ++i) {
+			const zone& z(buffer.zones[i % zone_capacity]);
+			copied_zone c = {
+				z.name.load(std::memory_order_relaxed),
+				z.start.load(std::memory_order_relaxed),
+				z.end.load(std::memory_order_relaxed)
+			};
+			zones.push_back(c);
+		}
+
+		// Zones overwritten while copying are skipped, and so is the
+		// zone that may be half written right now.
+		const ::Uint64 after = buffer.written.load(std::memory_order_acquire);
+		const ::Uint64 skip = after + 1 > zone_capacity + begin?
+			std::min<::Uint64>(after + 1 - zone_capacity - begin, zones.size()): 0;
+
+		const int tid = buffer.tid.load();
+		const char* name = buffer.name.load();
+		if (name) {
+			ostr << (first? "": ",") << boost::format("{\"ph\":\"M\",\"pid\":1,\"tid\":%1%,"
+				"\"name\":\"thread_name\",\"args\":{\"name\":") % tid;
+			write_json_string(ostr, name);
+			ostr << "}}";
+			first = false;
+		}
+
+		for (auto z = zones.begin() + skip; z != zones.end(); ++z) {
+			ostr << (first? "": ",") << "{\"ph\":\"X\",\"pid\":1,\"name\":";
+			write_json_string(ostr, z->name? z->name: "");
+			ostr << boost::format(",\"tid\":%1%,\"ts\":%2$.3f,\"dur\":%3$.3f}")
+				% tid
+				% (z->start / 1000.0)
+				% ((z->end - z->start) / 1000.0);
+			first = false;
+		}
+	}
+	ostr << "]}\n";
+}
+
+} // prf
+} // pup
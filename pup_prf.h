@@ -0,0 +1,424 @@
+
+// libPowerUP - Create games with SDL2 and OpenGL
+// Copyright(c) 2015, Erik Edlund <erik.edlund@32767.se>
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with
+// or without modification, are permitted provided that the
+// following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above
+//    copyright notice, this list of conditions and the
+//    following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above
+//    copyright notice, this list of conditions and the
+//    following disclaimer in the documentation and / or
+//    other materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names
+//    of its contributors may be used to endorse or promote
+//    products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES(INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+
+#ifndef LIBPUP_PUP_PRF_H
+#define LIBPUP_PUP_PRF_H
+
+#include "pup_env.h"
+#include "pup_core.h"
+#include "pup_mem.h"
+
+// Mark the rest of the enclosing scope as a named profiling
+// zone. Zones are recorded per thread and can be written out as
+// Chrome trace events with %pup::prf::write_trace(). Unless
+// PUP_TRACE is defined zones are compiled out entirely. The name
+// must be a string literal or otherwise outlive the trace.
+#ifdef PUP_TRACE
+#define PUP_ZONE_CAT_(a, b) a##b
+#define PUP_ZONE_CAT(a, b) PUP_ZONE_CAT_(a, b)
+#define PUP_ZONE(Name) \
+	pup::prf::scoped_zone PUP_ZONE_CAT(pup_zone_, __LINE__)(Name)
+#define PUP_THREAD_NAME(Name) \
+	pup::prf::set_thread_name(Name)
+#else
+#define PUP_ZONE(Name) do {} while (0)
+#define PUP_THREAD_NAME(Name) do {} while (0)
+#endif
+
+namespace pup {
+namespace prf {
+
+enum phase {
+	PHASE_REACT,
+	PHASE_THINK,
+	PHASE_BEFORE_RENDER,
+	PHASE_RENDER,
+	PHASE_AFTER_RENDER,
+	PHASE_MISC,
+	PHASE_FRAME, // the whole frame, including pacing
+	PHASE_COUNT
+};
+
+const char* phase_name(phase p) throw();
+
+// Write a quoted JSON string, leaving out control characters.
+void write_json_string(std::ostream& ostr, const char* str);
+
+enum counter {
+	COUNTER_CYCLES,
+	COUNTER_INSTRUCTIONS,
+	COUNTER_CACHE_MISSES,
+	COUNTER_BRANCH_MISSES,
+	COUNTER_COUNT
+};
+
+const char* counter_name(counter c) throw();
+
+typedef std::array<::Uint64, COUNTER_COUNT> counter_values;
+
+// Hardware performance counters of the calling thread, counting
+// in user space only and read together with a single system call.
+// Only implemented on Linux (perf_event_open). Elsewhere, or when
+// the kernel denies access (see perf_event_paranoid), they are
+// unavailable and read as zero. A counter the CPU lacks reads as
+// zero while the others still count.
+class hw_counters :
+	private boost::noncopyable
+{
+public:
+	hw_counters();
+	~hw_counters() throw();
+
+	bool available() const throw() { return group_ >= 0; }
+
+	// Why the counters are unavailable.
+	const std::string& get_error() const throw() { return error_; }
+
+	void read(counter_values& values) const throw();
+
+	// The counters of the calling thread, opened on first use.
+	static hw_counters& local();
+
+private:
+	int group_;
+	std::array<int, COUNTER_COUNT> fds_;
+	std::array<int, COUNTER_COUNT> slots_; // position in a group read
+	int open_;
+	std::string error_;
+};
+
+// Counters per frame averaged over the window of a profiler.
+struct counter_stats
+{
+	counter_stats() :
+		ipc(0.0)
+	{
+		per_frame.fill(0.0);
+	}
+
+	std::array<double, COUNTER_COUNT> per_frame;
+	double ipc; // instructions per cycle
+};
+
+// Nanoseconds since an arbitrary, fixed point in time.
+inline ::Sint64 now() throw()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// The mean and nearest-rank percentiles in nanoseconds.
+struct phase_stats
+{
+	phase_stats() :
+		mean(0),
+		p50(0),
+		p95(0),
+		p99(0),
+		max(0)
+	{}
+
+	::Sint64 mean;
+	::Sint64 p50;
+	::Sint64 p95;
+	::Sint64 p99;
+	::Sint64 max;
+};
+
+// Times the phases of every frame into a fixed-size ring buffer
+// covering the most recent frames. With counters enabled, the
+// hardware counters of the thread calling %begin() and %end() are
+// recorded per phase as well.
+class frame_profiler :
+	private boost::noncopyable
+{
+public:
+	explicit frame_profiler(size_type window = 1024);
+
+	void begin_frame() throw();
+	void end_frame() throw();
+
+	inline void begin(phase p) throw()
+	{
+		start_[p] = prf::now();
+		if (counters_)
+			counters_->read(start_counters_[p]);
+	}
+
+	inline void end(phase p) throw()
+	{
+		this->add(p, prf::now() - start_[p]);
+		if (counters_) {
+			counter_values values;
+			counters_->read(values);
+			for (int c = 0; c < COUNTER_COUNT; ++c)
+				current_counters_[p][c] += values[c] - start_counters_[p][c];
+		}
+	}
+
+	inline void add(phase p, ::Sint64 ns) throw() { current_[p] += ns; }
+
+	// Add counts measured elsewhere, e.g. on another thread.
+	inline void add(phase p, const counter_values& counts) throw()
+	{
+		for (int c = 0; c < COUNTER_COUNT; ++c)
+			current_counters_[p][c] += counts[c];
+	}
+
+	// Enable the counters of the calling thread. False, with the
+	// counters left disabled, if they are unavailable.
+	bool set_counters(bool enabled);
+	bool has_counters() const throw() { return counters_ != nullptr; }
+
+	counter_stats get_counter_stats(phase p) const throw();
+
+	// Statistics over the frames currently in the window.
+	phase_stats get_stats(phase p) const;
+
+	// The time spent in a phase during the most recently ended frame.
+	::Sint64 get_last(phase p) const throw();
+
+	size_type get_frame_count() const throw() { return count_; }
+	size_type get_window() const throw() { return frames_.size(); }
+	void set_window(size_type window);
+
+	void write_csv(const boost::filesystem::path& path) const;
+
+private:
+	typedef std::array<::Sint64, PHASE_COUNT> frame_record;
+	typedef std::array<counter_values, PHASE_COUNT> counter_record;
+
+	std::vector<frame_record> frames_;
+	mutable std::vector<::Sint64> scratch_;
+	size_type head_;
+	size_type count_;
+	frame_record current_;
+	frame_record start_;
+
+	hw_counters* counters_;
+	std::vector<counter_record> counter_frames_;
+	counter_record current_counters_;
+	counter_record start_counters_;
+};
+
+class scoped_phase :
+	private boost::noncopyable
+{
+public:
+	scoped_phase(frame_profiler& profiler, phase p) throw() :
+		profiler_(profiler),
+		phase_(p)
+	{
+		profiler_.begin(phase_);
+	}
+
+	~scoped_phase() throw()
+	{
+		profiler_.end(phase_);
+	}
+
+private:
+	frame_profiler& profiler_;
+	phase phase_;
+};
+
+// What the %flight_recorder keeps of every frame.
+struct flight_frame
+{
+	flight_frame() :
+		index(0),
+		end(0),
+		events_received(0),
+		events_delivered(0),
+		allocs(0),
+		alloc_bytes(0),
+		gpu_ns(0),
+		resolution_scale(1.0),
+		input_latency(0)
+	{
+		phases.fill(0);
+		controller[0] = '\0';
+	}
+
+	::Uint64 index;
+	::Sint64 end; // %prf::now() at the end of the frame
+	std::array<::Sint64, PHASE_COUNT> phases;
+	size_type events_received;
+	size_type events_delivered;
+	size_type allocs;
+	size_type alloc_bytes;
+	::Sint64 gpu_ns;
+	double resolution_scale;
+	::Sint64 input_latency; // the longest input to swap latency presented
+	char controller[32];
+};
+
+// Keeps the most recent frames in a ring buffer and tells when a
+// frame took longer than the budget, at most once per cooldown,
+// so that the frames leading up to the spike can be dumped.
+class flight_recorder :
+	private boost::noncopyable
+{
+public:
+	typedef std::vector<flight_frame> frame_vector;
+
+	explicit flight_recorder(size_type frames = 300);
+
+	// Record the frame, numbering it. True if it is a spike that
+	// should be dumped. Without a budget, or unless it may spike,
+	// no frame is.
+	bool record(const flight_frame& frame, bool may_spike = true) throw();
+
+	// The recorded frames, oldest first.
+	void snapshot(frame_vector& frames) const;
+
+	static void write_json(const boost::filesystem::path& path,
+		const frame_vector& frames, ::Sint64 budget);
+
+	void set_frames(size_type frames);
+	void set_budget(::Sint64 ns) throw() { budget_ = ns; }
+	void set_cooldown(::Sint64 ns) throw() { cooldown_ = ns; }
+
+	size_type get_frames() const throw() { return frames_.size(); }
+	::Sint64 get_budget() const throw() { return budget_; }
+	::Uint64 get_spikes() const throw() { return spikes_; }
+
+private:
+	frame_vector frames_;
+	size_type head_;
+	size_type count_;
+	::Sint64 budget_;
+	::Sint64 cooldown_;
+	::Sint64 last_dump_;
+	::Uint64 recorded_;
+	::Uint64 spikes_;
+};
+
+// Statistics in nanoseconds over the samples in a %latency_window.
+struct latency_stats
+{
+	latency_stats() :
+		count(0),
+		min(0),
+		mean(0),
+		p50(0),
+		p99(0),
+		max(0)
+	{}
+
+	size_type count;
+	::Sint64 min;
+	::Sint64 mean;
+	::Sint64 p50;
+	::Sint64 p99;
+	::Sint64 max;
+};
+
+// Keeps the most recent latency samples in a ring buffer.
+class latency_window :
+	private boost::noncopyable
+{
+public:
+	explicit latency_window(size_type window = 1024);
+
+	void add(::Sint64 ns) throw();
+
+	latency_stats get_stats() const;
+
+	// Samples added in total, including those no longer kept.
+	::Uint64 get_total() const throw() { return total_; }
+
+	size_type get_window() const throw() { return samples_.size(); }
+	void set_window(size_type window);
+
+private:
+	std::vector<::Sint64> samples_;
+	mutable std::vector<::Sint64> scratch_;
+	size_type head_;
+	size_type count_;
+	::Uint64 total_;
+};
+
+// Record a zone for the current thread. Never blocks, except for
+// the first zone recorded by a thread which registers its buffer.
+void record_zone(const char* name, ::Sint64 start, ::Sint64 end) throw();
+
+// Name the current thread in written traces.
+void set_thread_name(const char* name) throw();
+
+// Write the zones recorded so far, at most the most recent
+// %zone_capacity per thread, as Chrome/Perfetto trace JSON. The
+// buffer of a thread that has exited is reused by the next thread
+// recording zones, dropping the zones of the exited thread.
+void write_trace(const boost::filesystem::path& path);
+
+const size_type zone_capacity = 1 << 14;
+
+class scoped_zone :
+	private boost::noncopyable
+{
+public:
+	explicit scoped_zone(const char* name) throw() :
+		name_(name),
+		start_(prf::now())
+	{
+#ifdef PUP_TRACK_ALLOC
+		outer_ = mem::set_alloc_zone(name);
+#endif
+	}
+
+	~scoped_zone() throw()
+	{
+#ifdef PUP_TRACK_ALLOC
+		mem::set_alloc_zone(outer_);
+#endif
+		record_zone(name_, start_, prf::now());
+	}
+
+private:
+	const char* name_;
+	::Sint64 start_;
+#ifdef PUP_TRACK_ALLOC
+	const char* outer_;
+#endif
+};
+
+} // prf
+} // pup
+
+#endif
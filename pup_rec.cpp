@@ -0,0 +1,180 @@
+
+// libPowerUP - Create games with SDL2 and OpenGL
+// Copyright(c) 2015, Erik Edlund <erik.edlund@32767.se>
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with
+// or without modification, are permitted provided that the
+// following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above
+//    copyright notice, this list of conditions and the
+//    following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above
+//    copyright notice, this list of conditions and the
+//    following disclaimer in the documentation and / or
+//    other materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names
+//    of its contributors may be used to endorse or promote
+//    products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES(INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+
+#include "pup_rec.h"
+
+namespace pup {
+namespace rec {
+
+namespace {
+
+const char magic[4] = { 'P', 'U', 'P', 'R' };
+
+template <typename T>
+void write_value(std::ostream& ostr, const T& value)
+{
+	ostr.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+bool read_value(std::istream& istr, T& value)
+{
+	return static_cast<bool>(istr.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+} // anonymous
+
+bool is_recordable(const ::SDL_Event& event) throw()
+{
+	switch (event.type) {
+	case SDL_DROPFILE:
+	case SDL_DROPTEXT:
+	case SDL_DROPBEGIN:
+	case SDL_DROPCOMPLETE:
+	case SDL_SYSWMEVENT:
+		return false;
+	default:
+		return event.type < SDL_USEREVENT;
+	}
+}
+
+recorder::recorder(const boost::filesystem::path& path, ::Uint32 seed) :
+	ostr_(path.string(), std::ios::binary | std::ios::trunc),
+	frames_(0)
+{
+	if (!ostr_)
+		PUP_ERR(std::runtime_error, boost::str(boost::format(
+			"failed to open \"%1%\"") % path.string()));
+
+	ostr_.write(magic, sizeof(magic));
+	write_value(ostr_, format_version);
+	write_value(ostr_, seed);
+	write_value(ostr_, static_cast<::Uint32>(sizeof(::SDL_Event)));
+}
+
+recorder::~recorder() throw()
+{
+	ostr_.flush();
+}
+
+void recorder::write(::Sint64 hr_delta, ::Uint32 tick_delta,
+	const ::SDL_Event* events, size_type n)
+{
+	scratch_.clear();
+	for (size_type i = 0; i < n; ++i) {
+		if (is_recordable(events[i]))
+			scratch_.push_back(events[i]);
+	}
+
+	write_value(ostr_, hr_delta);
+	write_value(ostr_, tick_delta);
+	write_value(ostr_, static_cast<::Uint32>(scratch_.size()));
+	if (!scratch_.empty()) {
+		ostr_.write(reinterpret_cast<const char*>(&scratch_[0]),
+			scratch_.size() * sizeof(::SDL_Event));
+	}
+
+	if (!ostr_)
+		PUP_ERR(std::runtime_error, "failed to write session recording");
+	frames_++;
+}
+
+player::player(const boost::filesystem::path& path) :
+	istr_(path.string(), std::ios::binary),
+	path_(path.string()),
+	seed_(0),
+	frames_(0)
+{
+	if (!istr_)
+		PUP_ERR(std::runtime_error, boost::str(boost::format(
+			"failed to open \"%1%\"") % path_));
+
+	char m[sizeof(magic)];
+	::Uint32 version = 0;
+	::Uint32 event_size = 0;
+
+	if (
+		!istr_.read(m, sizeof(m)) ||
+		!std::equal(m, m + sizeof(m), magic) ||
+		!read_value(istr_, version) ||
+		!read_value(istr_, seed_) ||
+		!read_value(istr_, event_size)
+	) {
+		PUP_ERR(std::runtime_error, boost::str(boost::format(
+			"\"%1%\" is not a session recording") % path_));
+	}
+
+	if (version != format_version || event_size != sizeof(::SDL_Event)) {
+		PUP_ERR(std::runtime_error, boost::str(boost::format(
+			"\"%1%\" was recorded by an incompatible build (version=%2%, event_size=%3%)")
+				% path_ % version % event_size));
+	}
+}
+
+bool player::next(frame& f)
+{
+	::Uint32 count = 0;
+
+	if (!read_value(istr_, f.hr_delta))
+		return false;
+
+	if (!read_value(istr_, f.tick_delta) || !read_value(istr_, count))
+		PUP_ERR(std::runtime_error, boost::str(boost::format(
+			"\"%1%\" is truncated after %2% frames") % path_ % frames_));
+
+	f.events.resize(count);
+	if (count && !istr_.read(reinterpret_cast<char*>(&f.events[0]),
+		count * sizeof(::SDL_Event))) {
+		PUP_ERR(std::runtime_error, boost::str(boost::format(
+			"\"%1%\" is truncated after %2% frames") % path_ % frames_));
+	}
+
+	frames_++;
+	return true;
+}
+
+std::unique_ptr<player> open_player(const boost::program_options::variables_map& opt_vm)
+{
+	std::unique_ptr<player> p;
+	if (opt_vm.count("replay"))
+		p.reset(new player(opt_vm["replay"].as<std::string>()));
+	return p;
+}
+
+} // rec
+} // pup
@@ -0,0 +1,119 @@
+
+// libPowerUP - Create games with SDL2 and OpenGL
+// Copyright(c) 2015, Erik Edlund <erik.edlund@32767.se>
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with
+// or without modification, are permitted provided that the
+// following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above
+//    copyright notice, this list of conditions and the
+//    following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above
+//    copyright notice, this list of conditions and the
+//    following disclaimer in the documentation and / or
+//    other materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names
+//    of its contributors may be used to endorse or promote
+//    products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+// CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED.IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES(INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+
+#ifndef LIBPUP_PUP_REC_H
+#define LIBPUP_PUP_REC_H
+
+#include "pup_env.h"
+#include "pup_core.h"
+
+namespace pup {
+namespace rec {
+
+// Session recordings are a header followed by one record per
+// frame, all in native byte order:
+//
+//   header: "PUPR", Uint32 version, Uint32 seed, Uint32 event size
+//   frame:  Sint64 hr delta (ns), Uint32 tick delta (ms),
+//           Uint32 event count, SDL_Event[event count]
+//
+// Events carrying pointers (drop, user and window manager
+// events) can not be replayed and are left out.
+const ::Uint32 format_version = 1;
+
+struct frame
+{
+	frame() :
+		hr_delta(0),
+		tick_delta(0)
+	{}
+
+	::Sint64 hr_delta;
+	::Uint32 tick_delta;
+	std::vector<::SDL_Event> events;
+};
+
+bool is_recordable(const ::SDL_Event& event) throw();
+
+// Writes the events delivered to the controller and the timer
+// deltas of every frame.
+class recorder :
+	private boost::noncopyable
+{
+public:
+	explicit recorder(const boost::filesystem::path& path, ::Uint32 seed);
+	~recorder() throw();
+
+	void write(::Sint64 hr_delta, ::Uint32 tick_delta,
+		const ::SDL_Event* events, size_type n);
+
+	::Uint32 get_frames() const throw() { return frames_; }
+
+private:
+	std::ofstream ostr_;
+	std::vector<::SDL_Event> scratch_;
+	::Uint32 frames_;
+};
+
+// Reads a session written by %recorder one frame at a time.
+class player :
+	private boost::noncopyable
+{
+public:
+	explicit player(const boost::filesystem::path& path);
+
+	// False once the recording is exhausted.
+	bool next(frame& f);
+
+	::Uint32 get_seed() const throw() { return seed_; }
+	::Uint32 get_frames() const throw() { return frames_; }
+
+private:
+	std::ifstream istr_;
+	std::string path_;
+	::Uint32 seed_;
+	::Uint32 frames_;
+};
+
+// The player of the session given by --replay, null without it.
+std::unique_ptr<player> open_player(const boost::program_options::variables_map& opt_vm);
+
+} // rec
+} // pup
+
+#endif
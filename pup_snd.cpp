@@ -37,6 +37,7 @@
 // SUCH DAMAGE.
 
 #include "pup_snd.h"
+#include "pup_prf.h"
 
 namespace pup {
 namespace snd {
@@ -158,35 +159,50 @@ jukebox::~jukebox() throw()
 
 ::Uint32 jukebox::load_dir(const boost::filesystem::path& dir)
 {
+	// %scan_dir() has already filtered the files.
+	return this->set_files(jukebox::scan_dir(dir));
+}
+
+::Uint32 jukebox::load_files(const io::path_list& files)
+{
+	io::path_list playable(files);
+	jukebox::filter_files(playable);
+	return this->set_files(std::move(playable));
+}
+
+::Uint32 jukebox::set_files(io::path_list files)
+{
+	track_ = files_.end();
+	history_.clear();
+	files_.swap(files);
+	track_ = files_.end();
+	return files_.size();
+}
+
+io::path_list jukebox::scan_dir(const boost::filesystem::path& dir)
+{
+	PUP_ZONE("snd::jukebox::scan_dir");
+
 	if (!boost::filesystem::is_directory(dir)) {
 		PUP_ERR(std::runtime_error, boost::str(boost::format(
 			"path \"%1%\" is not a directory") % dir.string()
 		));
 	}
-	files_.clear();
+
+	io::path_list files;
 	std::copy(
 		boost::filesystem::directory_iterator(dir),
 		boost::filesystem::directory_iterator(),
-		std::back_inserter(files_)
+		std::back_inserter(files)
 	);
-	return this->filter_files();
-}
-
-::Uint32 jukebox::load_files(const io::path_list& files)
-{
-	track_ = files_.end();
-	history_.clear();
-	files_.clear();
-	std::copy(
-		files.begin(),
-		files.end(),
-		std::back_inserter(files_)
-	);
-	return this->filter_files();
+	jukebox::filter_files(files);
+	return files;
 }
 
 void jukebox::update(music& mus)
 {
+	PUP_ZONE("snd::jukebox::update");
+
 	if (running_ && !mus.playing() && !files_.empty()) {
 		if (random_) {
 			io::path_list::iterator it;
@@ -212,9 +228,9 @@ void jukebox::update(music& mus)
 	}
 }
 
-::Uint32 jukebox::filter_files()
+void jukebox::filter_files(io::path_list& files)
 {
-	for (auto it = files_.begin(); it != files_.end(); /* in-loop */) {
+	for (auto it = files.begin(); it != files.end(); /* in-loop */) {
 		if (
 			boost::filesystem::is_regular_file(*it) && (
 				it->extension().string() == ".mp3" ||
@@ -224,10 +240,9 @@ void jukebox::update(music& mus)
 		) {
 			++it;
 		} else {
-			it = files_.erase(it);
+			it = files.erase(it);
 		}
 	}
-	return files_.size();
 }
 
 } // snd
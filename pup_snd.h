@@ -114,6 +114,11 @@ public:
 	::Uint32 load_dir(const boost::filesystem::path& dir);
 	::Uint32 load_files(const io::path_list& files);
 
+	// The playable files in a directory. Touches no jukebox and
+	// may be called from any thread, e.g. to scan on the job
+	// system and then %load_files() on the main thread.
+	static io::path_list scan_dir(const boost::filesystem::path& dir);
+
 	void update(music& mus);
 
 	inline void start() throw() { running_ = true; }
@@ -134,7 +139,8 @@ public:
 	}
 
 private:
-	::Uint32 filter_files();
+	::Uint32 set_files(io::path_list files);
+	static void filter_files(io::path_list& files);
 
 	bool running_;
 	bool random_;
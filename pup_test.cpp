@@ -286,3 +286,654 @@ TEST_CASE("rotation works as expected", "[pup::t]") {
 }
 
 
+
+TEST_CASE("jobs are scheduled and waited for", "[pup::job]") {
+	pup::job::scheduler jobs(3);
+
+	SECTION("parallel_for visits every index exactly once") {
+		std::vector<int> hits(1000, 0);
+		jobs.parallel_for(0, hits.size(), 7, [&](pup::size_type first, pup::size_type last) {
+			for (pup::size_type i = first; i < last; ++i)
+				hits[i]++;
+		});
+		REQUIRE(std::count(hits.begin(), hits.end(), 1) == 1000);
+	}
+
+	SECTION("continuations run after their counter reaches zero") {
+		std::atomic<int> done(0);
+		std::atomic<int> seen(-1);
+		pup::job::counter first;
+		pup::job::counter second;
+		for (int i = 0; i < 16; ++i)
+			jobs.submit([&]() { done++; }, &first);
+		jobs.then(first, [&]() { seen = done.load(); }, &second);
+		jobs.wait(second);
+		REQUIRE(seen == 16);
+	}
+
+	SECTION("a failed job is rethrown to its waiter once all are done") {
+		std::vector<int> hits(64, 0);
+		REQUIRE_THROWS_AS(jobs.parallel_for(0, hits.size(), 1,
+			[&](pup::size_type first, pup::size_type last) {
+				if (first == 5)
+					PUP_ERR(std::runtime_error, "chunk failed");
+				for (pup::size_type i = first; i < last; ++i)
+					hits[i]++;
+			}), std::runtime_error);
+		REQUIRE(std::count(hits.begin(), hits.end(), 1) == 63);
+
+		pup::job::counter c;
+		jobs.submit([]() {}, &c);
+		jobs.wait(c);
+	}
+}
+
+TEST_CASE("queued jobs run before the scheduler is destroyed", "[pup::job]") {
+	std::atomic<int> ran(0);
+	{
+		pup::job::scheduler jobs(1);
+		for (int i = 0; i < 64; ++i) {
+			jobs.submit([&]() {
+				std::this_thread::sleep_for(std::chrono::microseconds(100));
+				ran++;
+			});
+		}
+	}
+	REQUIRE(ran == 64);
+}
+
+TEST_CASE("phases run after their dependencies", "[pup::job]") {
+	pup::job::graph graph;
+	std::mutex mutex;
+	std::vector<std::string> order;
+	std::thread::id main_id;
+
+	auto phase = [&](const std::string& name) {
+		return [&, name]() {
+			std::lock_guard<std::mutex> lock(mutex);
+			order.push_back(name);
+		};
+	};
+
+	const pup::job::graph::node a = graph.add("a", phase("a"), {}, true);
+	const pup::job::graph::node b = graph.add("b", phase("b"), { a });
+	const pup::job::graph::node c = graph.add("c", [&]() {
+		main_id = std::this_thread::get_id();
+	}, { a }, true);
+	graph.add("d", phase("d"), { b, c });
+	graph.run();
+
+	REQUIRE(order.size() == 3);
+	REQUIRE(order.front() == "a");
+	REQUIRE(order.back() == "d");
+	REQUIRE(main_id == std::this_thread::get_id());
+
+	pup::job::graph failing;
+	bool ran = false;
+	const pup::job::graph::node e = failing.add("e", []() {
+		throw std::runtime_error("e");
+	});
+	failing.add("f", [&]() { ran = true; }, { e });
+	REQUIRE_THROWS_AS(failing.run(), std::runtime_error);
+	REQUIRE(!ran);
+	REQUIRE_THROWS_AS(failing.add("g", []() {}, { 5 }), std::logic_error);
+}
+
+TEST_CASE("redundant events are coalesced", "[pup::event_pump]") {
+	::SDL_Event events[6];
+	std::memset(events, 0, sizeof(events));
+
+	for (int i = 0; i < 3; ++i) {
+		events[i].type = SDL_MOUSEMOTION;
+		events[i].motion.x = 10 * (i + 1);
+		events[i].motion.xrel = 10;
+		events[i].motion.yrel = i;
+	}
+	events[3].type = SDL_KEYDOWN;
+	events[4].type = SDL_WINDOWEVENT;
+	events[4].window.event = SDL_WINDOWEVENT_RESIZED;
+	events[4].window.data1 = 640;
+	events[5].type = SDL_WINDOWEVENT;
+	events[5].window.event = SDL_WINDOWEVENT_RESIZED;
+	events[5].window.data1 = 800;
+
+	REQUIRE(pup::event_pump::coalesce(events, 6) == 3);
+	REQUIRE(events[0].type == SDL_MOUSEMOTION);
+	REQUIRE(events[0].motion.x == 30);
+	REQUIRE(events[0].motion.xrel == 30);
+	REQUIRE(events[0].motion.yrel == 3);
+	REQUIRE(events[1].type == SDL_KEYDOWN);
+	REQUIRE(events[2].type == SDL_WINDOWEVENT);
+	REQUIRE(events[2].window.data1 == 800);
+}
+
+TEST_CASE("frame phase percentiles", "[pup::prf]") {
+	pup::prf::frame_profiler profiler(100);
+
+	for (int i = 1; i <= 200; ++i) {
+		profiler.begin_frame();
+		profiler.add(pup::prf::PHASE_RENDER, i);
+		profiler.end_frame();
+	}
+
+	const pup::prf::phase_stats stats(profiler.get_stats(pup::prf::PHASE_RENDER));
+	REQUIRE(profiler.get_frame_count() == 100);
+	REQUIRE(profiler.get_last(pup::prf::PHASE_RENDER) == 200);
+	REQUIRE(stats.mean == 150);
+	REQUIRE(stats.p50 == 150);
+	REQUIRE(stats.p95 == 195);
+	REQUIRE(stats.p99 == 199);
+	REQUIRE(stats.max == 200);
+}
+
+TEST_CASE("zones are written as chrome trace events", "[pup::prf]") {
+	boost::filesystem::path path(boost::filesystem::temp_directory_path()
+		/ boost::filesystem::unique_path("pup-trace-%%%%%%.json"));
+
+	pup::prf::record_zone("outer \"zone\"", 1000, 5000);
+	std::thread([]() { pup::prf::record_zone("other", 2000, 3000); }).join();
+	pup::prf::write_trace(path);
+
+	boost::property_tree::ptree pt;
+	boost::property_tree::json_parser::read_json(path.string(), pt);
+	boost::filesystem::remove(path);
+
+	std::map<std::string, boost::property_tree::ptree> events;
+	BOOST_FOREACH(const boost::property_tree::ptree::value_type& v, pt.get_child("traceEvents"))
+		events[v.second.get<std::string>("name")] = v.second;
+
+	REQUIRE(events.count("outer \"zone\"") == 1);
+	REQUIRE(events.count("other") == 1);
+	REQUIRE(events["outer \"zone\""].get<double>("dur") == 4.0);
+	REQUIRE(events["outer \"zone\""].get<int>("tid") != events["other"].get<int>("tid"));
+}
+
+TEST_CASE("zone buffers of exited threads are reused", "[pup::prf]") {
+	boost::filesystem::path path(boost::filesystem::temp_directory_path()
+		/ boost::filesystem::unique_path("pup-trace-%%%%%%.json"));
+
+	for (int i = 0; i < 32; ++i)
+		std::thread([]() { pup::prf::record_zone("churn", 2000, 3000); }).join();
+	pup::prf::write_trace(path);
+
+	boost::property_tree::ptree pt;
+	boost::property_tree::json_parser::read_json(path.string(), pt);
+	boost::filesystem::remove(path);
+
+	int churn = 0;
+	BOOST_FOREACH(const boost::property_tree::ptree::value_type& v, pt.get_child("traceEvents"))
+		churn += v.second.get<std::string>("name") == "churn";
+	REQUIRE(churn == 1);
+}
+
+TEST_CASE("recorded sessions are replayed", "[pup::rec]") {
+	boost::filesystem::path path(boost::filesystem::temp_directory_path()
+		/ boost::filesystem::unique_path("pup-session-%%%%%%.rec"));
+
+	::SDL_Event events[3];
+	std::memset(events, 0, sizeof(events));
+	events[0].type = SDL_KEYDOWN;
+	events[1].type = SDL_DROPFILE;
+	events[2].type = SDL_MOUSEMOTION;
+	events[2].motion.x = 42;
+
+	{
+		pup::rec::recorder recorder(path, 1234);
+		recorder.write(16000000, 16, events, 3);
+		recorder.write(17000000, 17, nullptr, 0);
+	}
+
+	pup::rec::player player(path);
+	pup::rec::frame f;
+
+	REQUIRE(player.get_seed() == 1234);
+	REQUIRE(player.next(f));
+	REQUIRE(f.hr_delta == 16000000);
+	REQUIRE(f.tick_delta == 16);
+	REQUIRE(f.events.size() == 2);
+	REQUIRE(f.events[0].type == SDL_KEYDOWN);
+	REQUIRE(f.events[1].motion.x == 42);
+	REQUIRE(player.next(f));
+	REQUIRE(f.hr_delta == 17000000);
+	REQUIRE(f.events.empty());
+	REQUIRE(!player.next(f));
+	REQUIRE(player.get_frames() == 2);
+
+	boost::filesystem::remove(path);
+}
+
+TEST_CASE("a replay is opened from the options", "[pup::rec]") {
+	boost::filesystem::path session(boost::filesystem::temp_directory_path()
+		/ boost::filesystem::unique_path("pup-session-%%%%%%.rec"));
+
+	{
+		pup::rec::recorder recorder(session, 1234);
+		recorder.write(16000000, 16, nullptr, 0);
+	}
+
+	const std::string session_path(session.string());
+	const char* argv[] = {
+		"pup_test",
+		"--replay", session_path.c_str()
+	};
+	boost::program_options::options_description opt_desc(pup::default_program_options());
+	boost::program_options::variables_map opt_vm;
+	boost::program_options::store(boost::program_options::parse_command_line(
+		sizeof(argv) / sizeof(argv[0]), argv, opt_desc), opt_vm);
+	boost::program_options::notify(opt_vm);
+
+	std::unique_ptr<pup::rec::player> player(pup::rec::open_player(opt_vm));
+	REQUIRE(player.get() != nullptr);
+	REQUIRE(player->get_seed() == 1234);
+
+	boost::program_options::variables_map no_replay;
+	boost::program_options::store(boost::program_options::parse_command_line(
+		1, argv, opt_desc), no_replay);
+	REQUIRE(pup::rec::open_player(no_replay).get() == nullptr);
+
+	player.reset();
+	boost::filesystem::remove(session);
+}
+
+TEST_CASE("config is parsed and validated", "[pup::cfg]") {
+	std::istringstream istr(
+		"[general]\n"
+		"random_seed=7\n"
+		"tick_rate=60\n"
+		"[graphics]\n"
+		"vsync=1\n"
+		"window_width=800\n"
+		"window_height=600\n"
+		"window_fullscreen=false\n"
+		"fov=60\n"
+		"z_near=0.5\n"
+		"z_far=500\n"
+		"[sound]\n"
+		"music_volume=64\n"
+		"[menu]\n"
+		"quit=escape\n"
+	);
+	boost::property_tree::ptree pt;
+	boost::property_tree::ini_parser::read_ini(istr, pt);
+
+	pup::cfg::config config;
+	config.load(pt);
+
+	REQUIRE(config.random_seed == 7);
+	REQUIRE(config.tick_rate == 60);
+	REQUIRE(config.tick_lim == 5);
+	REQUIRE(config.vsync == 1);
+	REQUIRE(config.window_width == 800);
+	REQUIRE(config.fov == 60.0f);
+	REQUIRE(config.music_volume == 64);
+	REQUIRE(config.values.at("menu.quit") == "escape");
+	REQUIRE(config.values.count("menu.missing") == 0);
+	REQUIRE(config.background_rate == 0.0);
+
+	pt.put("general.background_rate", -1.0);
+	REQUIRE_THROWS_AS(config.load(pt), std::runtime_error);
+	pt.put("general.background_rate", 5.0);
+	config.load(pt);
+	REQUIRE(config.background_rate == 5.0);
+
+	REQUIRE(config.frame_latency == 0);
+	pt.put("graphics.frame_latency", 4);
+	REQUIRE_THROWS_AS(config.load(pt), std::runtime_error);
+	pt.put("graphics.frame_latency", 2);
+	config.load(pt);
+	REQUIRE(config.frame_latency == 2);
+
+	pt.put("graphics.z_far", 0.25f);
+	REQUIRE_THROWS_AS(config.load(pt), std::runtime_error);
+}
+
+TEST_CASE("arena hands out aligned memory and merges on reset", "[pup::mem]") {
+	pup::mem::arena a(64);
+
+	char* c = static_cast<char*>(a.allocate(1, 1));
+	double* d = static_cast<double*>(a.allocate(sizeof(double), alignof(double)));
+	REQUIRE(c != nullptr);
+	REQUIRE(reinterpret_cast<std::uintptr_t>(d) % alignof(double) == 0);
+
+	a.allocate(256);
+	REQUIRE(a.get_capacity() > 64);
+	REQUIRE(a.get_used() >= 256 + sizeof(double) + 1);
+
+	const pup::size_type capacity = a.get_capacity();
+	a.reset();
+	REQUIRE(a.get_used() == 0);
+	REQUIRE(a.get_capacity() == capacity);
+
+	a.allocate(capacity);
+	REQUIRE(a.get_capacity() == capacity);
+
+	pup::mem::arena_allocator<int> alloc(a);
+	a.reset();
+	std::vector<int, pup::mem::arena_allocator<int>> v(alloc);
+	for (int i = 0; i < 100; ++i)
+		v.push_back(i);
+	REQUIRE(v[99] == 99);
+	REQUIRE(a.get_peak() >= 100 * sizeof(int));
+
+	pup::mem::frame_string s("frame");
+	s += " string";
+	REQUIRE(s == "frame string");
+	pup::mem::frame_arena().reset();
+}
+
+TEST_CASE("allocations are counted per frame", "[pup::mem]") {
+	pup::mem::end_alloc_frame();
+	std::unique_ptr<int[]> p(new int[64]);
+	const pup::mem::alloc_stats stats(pup::mem::end_alloc_frame());
+
+	if (pup::mem::alloc_tracking()) {
+		REQUIRE(stats.allocs >= 1);
+		REQUIRE(stats.bytes >= 64 * sizeof(int));
+		REQUIRE(stats.peak_live >= 64 * sizeof(int));
+	} else {
+		REQUIRE(stats.allocs == 0);
+		REQUIRE(stats.bytes == 0);
+	}
+}
+
+namespace {
+
+// Keeps the messages written to Boost.Log. While closed, the
+// backend thread is held in %consume(), so nothing is drained.
+class capture_backend :
+	public boost::log::sinks::basic_sink_backend<boost::log::sinks::synchronized_feeding>
+{
+public:
+	capture_backend() : consuming_(false), closed_(false) {}
+
+	void consume(const boost::log::record_view& rec)
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		messages_.push_back(rec[boost::log::expressions::smessage].get());
+		consuming_ = true;
+		cond_.notify_all();
+		cond_.wait(lock, [this]() { return !closed_; });
+	}
+
+	void close()
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		closed_ = true;
+		consuming_ = false;
+	}
+
+	void open()
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		closed_ = false;
+		cond_.notify_all();
+	}
+
+	void wait_consuming()
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		cond_.wait(lock, [this]() { return consuming_; });
+	}
+
+	std::vector<std::string> get_messages()
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		return messages_;
+	}
+
+private:
+	std::mutex mutex_;
+	std::condition_variable cond_;
+	std::vector<std::string> messages_;
+	bool consuming_;
+	bool closed_;
+};
+
+} // anonymous
+
+TEST_CASE("log records are queued and flushed", "[pup::log]") {
+	typedef boost::log::sinks::synchronous_sink<capture_backend> capture_sink;
+
+	boost::shared_ptr<capture_backend> backend(new capture_backend());
+	boost::shared_ptr<capture_sink> sink(new capture_sink(backend));
+	boost::log::core::get()->add_sink(sink);
+
+	{
+		pup::log::scoped_backend logging;
+
+		const pup::size_type dropped = pup::log::get_dropped();
+		for (int i = 0; i < 8; ++i)
+			PUP_LOG(trace) << "record " << i;
+		const int n = 42;
+		pup::log::write_lazy(boost::log::trivial::trace, [n](std::ostream& ostr) {
+			ostr << "lazy " << n;
+		});
+		PUP_LOG(info) << std::string(2 * pup::log::record_size, 'x');
+
+		pup::log::flush();
+		REQUIRE(pup::log::get_pending() == 0);
+		REQUIRE(pup::log::get_dropped() == dropped);
+
+		std::vector<std::string> messages(backend->get_messages());
+		REQUIRE(messages.size() == 10);
+		REQUIRE(messages[0] == "record 0");
+		REQUIRE(messages[7] == "record 7");
+		REQUIRE(messages[8] == "lazy 42");
+		REQUIRE(messages[9] == std::string(pup::log::record_size, 'x'));
+
+		pup::log::set_threshold(boost::log::trivial::warning);
+		REQUIRE(!pup::log::enabled(boost::log::trivial::info));
+		PUP_LOG(info) << "filtered";
+		pup::log::flush();
+		REQUIRE(backend->get_messages().size() == 10);
+		pup::log::set_threshold(boost::log::trivial::trace);
+		boost::log::core::get()->reset_filter();
+
+		// Hold the backend thread in the sink and overfill the queue.
+		backend->close();
+		PUP_LOG(info) << "held";
+		backend->wait_consuming();
+		for (pup::size_type i = 0; i < pup::log::queue_capacity + 1; ++i)
+			PUP_LOG(info) << "overflow";
+		REQUIRE(pup::log::get_dropped() > dropped);
+		backend->open();
+	}
+
+	boost::log::core::get()->remove_sink(sink);
+}
+
+TEST_CASE("hardware counters are optional", "[pup::prf]") {
+	pup::prf::frame_profiler profiler(8);
+
+	const bool available = pup::prf::hw_counters::local().available();
+	REQUIRE(profiler.set_counters(true) == available);
+	REQUIRE(profiler.has_counters() == available);
+
+	for (int i = 0; i < 4; ++i) {
+		profiler.begin_frame();
+		profiler.begin(pup::prf::PHASE_THINK);
+		profiler.end(pup::prf::PHASE_THINK);
+		profiler.end_frame();
+	}
+
+	const pup::prf::counter_stats stats(profiler.get_counter_stats(pup::prf::PHASE_FRAME));
+	if (available)
+		REQUIRE(stats.per_frame[pup::prf::COUNTER_CYCLES] > 0.0);
+	else
+		REQUIRE(stats.ipc == 0.0);
+
+	REQUIRE(profiler.set_counters(false));
+	REQUIRE_FALSE(profiler.has_counters());
+}
+
+TEST_CASE("spikes are reported once per cooldown", "[pup::prf]") {
+	pup::prf::flight_recorder recorder(4);
+	recorder.set_budget(1000);
+	recorder.set_cooldown(100);
+
+	std::vector<bool> dumps;
+	for (int i = 0; i < 10; ++i) {
+		pup::prf::flight_frame frame;
+		frame.end = i * 50;
+		frame.phases[pup::prf::PHASE_FRAME] = (i == 5 || i == 6 || i == 9)? 2000: 10;
+		dumps.push_back(recorder.record(frame));
+	}
+	REQUIRE(dumps == std::vector<bool>({ false, false, false, false, false,
+		true, false, false, false, true }));
+	REQUIRE(recorder.get_spikes() == 3);
+
+	pup::prf::flight_recorder::frame_vector frames;
+	recorder.snapshot(frames);
+	REQUIRE(frames.size() == 4);
+	REQUIRE(frames.front().index == 6);
+	REQUIRE(frames.back().index == 9);
+}
+
+TEST_CASE("metrics endpoints are validated", "[pup::mtr]") {
+	boost::asio::io_service io;
+
+	REQUIRE_THROWS_AS(pup::mtr::server(io, "udp:1234", 1000000), std::runtime_error);
+
+	pup::mtr::server server(io, "tcp:0", 1000000);
+	server.push(pup::mtr::sample());
+	REQUIRE(server.get_clients() == 0);
+	REQUIRE(server.get_dropped() == 0);
+}
+
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+TEST_CASE("only sockets are replaced by the metrics server", "[pup::mtr]") {
+	boost::asio::io_service io;
+	boost::filesystem::path path(boost::filesystem::temp_directory_path()
+		/ boost::filesystem::unique_path("pup-metrics-%%%%%%"));
+
+	std::ofstream(path.string()) << "keep";
+	REQUIRE_THROWS_AS(pup::mtr::server(io, "unix:" + path.string(), 1000000),
+		std::runtime_error);
+	REQUIRE(boost::filesystem::is_regular_file(path));
+	boost::filesystem::remove(path);
+
+	{
+		boost::asio::local::stream_protocol::acceptor stale(io,
+			boost::asio::local::stream_protocol::endpoint(path.string()));
+	}
+	REQUIRE(boost::filesystem::exists(path));
+	pup::mtr::server server(io, "unix:" + path.string(), 1000000);
+}
+
+TEST_CASE("metrics are streamed to clients", "[pup::mtr]") {
+	boost::asio::io_service io;
+	boost::filesystem::path path(boost::filesystem::temp_directory_path()
+		/ boost::filesystem::unique_path("pup-metrics-%%%%%%"));
+	pup::mtr::server server(io, "unix:" + path.string(), 1000000, 4);
+
+	boost::asio::local::stream_protocol::socket client(io);
+	client.connect(boost::asio::local::stream_protocol::endpoint(path.string()));
+	while (!server.get_clients())
+		io.run_one();
+
+	pup::mtr::sample s;
+	s.frame.end = 1000000;
+	server.push(s);
+	while (!client.available())
+		io.run_one();
+
+	boost::asio::streambuf buf;
+	boost::asio::read_until(client, buf, '\n');
+	std::istream istr(&buf);
+	std::string line;
+	std::getline(istr, line);
+	REQUIRE(boost::starts_with(line, "{\"time_ms\":1.0,\"frames\":1,"));
+	REQUIRE(boost::ends_with(line, "}"));
+	REQUIRE(buf.size() == 0);
+	REQUIRE(!client.available());
+
+	// Stop reading until lines are dropped, then publish a last one.
+	for (int i = 0; i < 100000 && !server.get_dropped(); ++i) {
+		s.frame.end += 1000000;
+		server.push(s);
+		io.run_one();
+	}
+	REQUIRE(server.get_dropped() > 0);
+
+	const ::Uint64 dropped = server.get_dropped();
+	s.frame.end = 999000000000;
+	server.push(s);
+	while (server.get_dropped() == dropped)
+		io.run_one();
+
+	// The oldest queued line was dropped, the last one arrives.
+	const std::string last("{\"time_ms\":999000.0,");
+	std::string received;
+	while (received.find(last) == std::string::npos || !boost::ends_with(received, "\n")) {
+		io.poll();
+		char chunk[4096];
+		boost::system::error_code ec;
+		if (client.available())
+			received.append(chunk, client.read_some(boost::asio::buffer(chunk), ec));
+	}
+	REQUIRE(received.rfind("{\"time_ms\":") == received.find(last));
+}
+#endif
+
+TEST_CASE("key chords are parsed and actions resolved", "[pup::key_dispatcher]") {
+	pup::key_chord chord = pup::key_chord::parse("ctrl+shift+F5");
+	REQUIRE(chord.scancode == SDL_SCANCODE_F5);
+	REQUIRE(chord.mods == (pup::key_chord::MOD_CTRL | pup::key_chord::MOD_SHIFT));
+	REQUIRE(pup::key_chord::mods_of(KMOD_RCTRL | KMOD_LSHIFT | KMOD_NUM) == chord.mods);
+	REQUIRE(pup::key_chord::mods_name(chord.mods) == "ctrl+shift+");
+	REQUIRE_THROWS_AS(pup::key_chord::parse("hyper+F5"), std::runtime_error);
+	REQUIRE_THROWS_AS(pup::key_chord::parse("ctrl+nokey"), std::runtime_error);
+
+	REQUIRE(pup::global::keynames.at(SDLK_KP_8) == "kp_8");
+	REQUIRE(pup::global::keynames.size() == pup::global::keycodes.size());
+
+	std::istringstream istr(
+		"[general]\n"
+		"random_seed=7\n"
+		"[graphics]\n"
+		"vsync=1\n"
+		"window_width=800\n"
+		"window_height=600\n"
+		"window_fullscreen=false\n"
+		"fov=60\n"
+		"z_near=0.5\n"
+		"z_far=500\n"
+		"[sound]\n"
+		"music_volume=64\n"
+		"[menu]\n"
+		"quit=home, alt+F4\n"
+		"broken=ctrl+\n"
+	);
+	boost::property_tree::ptree pt;
+	boost::property_tree::ini_parser::read_ini(istr, pt);
+
+	pup::cfg::config config;
+	config.load(pt);
+	pup::action_map actions(config);
+
+	pup::action_map::chord_vector chords = actions.find("menu.quit");
+	REQUIRE(chords.size() == 2);
+	REQUIRE(chords[0].scancode == SDL_SCANCODE_HOME);
+	REQUIRE(chords[0].mods == 0);
+	REQUIRE(chords[1].scancode == SDL_SCANCODE_F4);
+	REQUIRE(chords[1].mods == pup::key_chord::MOD_ALT);
+	REQUIRE_THROWS_AS(actions.find("menu.broken"), std::runtime_error);
+	REQUIRE_THROWS_AS(actions.find("menu.missing"), std::runtime_error);
+}
+
+TEST_CASE("latency percentiles over a window", "[pup::prf]") {
+	pup::prf::latency_window window(4);
+	REQUIRE(window.get_stats().count == 0);
+
+	for (::Sint64 ns = 1; ns <= 6; ++ns)
+		window.add(ns * 1000);
+
+	const pup::prf::latency_stats stats(window.get_stats());
+	REQUIRE(window.get_total() == 6);
+	REQUIRE(stats.count == 4);
+	REQUIRE(stats.min == 3000);
+	REQUIRE(stats.mean == 4500);
+	REQUIRE(stats.p50 == 4000);
+	REQUIRE(stats.p99 == 6000);
+	REQUIRE(stats.max == 6000);
+}